@@ -1,19 +1,21 @@
 #!/usr/bin/lua
-local command = '/usr/bin/time 2>&1 -f "%U" ./erfindung-cli > /dev/null demos/pref-test.efas'
+local base_command = '/usr/bin/time 2>&1 -f "%U" ./erfindung-cli > /dev/null demos/pref-test.efas'
+local command = base_command
+-- each of the CPU's instruction dispatchers is benchmarked in turn
+local dispatchers = { 'switch', 'threaded' }
 --command = 'do-stuff'
 local max_concurrency = 4
 local max_tests       = 12
 local function do_cleanup()
     os.execute('make clean ; rm erfindung-cli')
 end
-local function do_benchmark(handle_result)
-    local function do_clean_and_build()
-        do_cleanup();
-        if not os.execute('make -j '..max_concurrency) then
-            assert(false)
-        end
+local function do_clean_and_build()
+    do_cleanup();
+    if not os.execute('make -j '..max_concurrency) then
+        assert(false)
     end
-    do_clean_and_build()
+end
+local function do_benchmark(handle_result)
     for i = 1, math.floor(max_tests / max_concurrency) do
         local product_command = ''
         for j = 1, max_concurrency do
@@ -60,14 +62,18 @@ local function get_stats_on(stats, name)
 end
 
 local function do_benchmark_runs()
-	local inst_per_sec = {}
-	do_benchmark(function(benchmark_res)
-	    for line in benchmark_res:lines() do
-	        local et = tonumber(line)
-	        inst_per_sec[#inst_per_sec + 1] = ((10000000) / et)*21
-	    end
-	end)
-	get_stats_on(inst_per_sec, 'instructions per second')
+	do_clean_and_build()
+	for _, dispatcher in ipairs(dispatchers) do
+		local inst_per_sec = {}
+		command = base_command..' -d '..dispatcher
+		do_benchmark(function(benchmark_res)
+		    for line in benchmark_res:lines() do
+		        local et = tonumber(line)
+		        inst_per_sec[#inst_per_sec + 1] = ((10000000) / et)*21
+		    end
+		end)
+		get_stats_on(inst_per_sec, 'instructions per second ('..dispatcher..')')
+	end
 end
 
 do_benchmark_runs()
@@ -17,8 +17,14 @@ SOURCES += \
     ../src/AssemblerPrivate/LineParsingHelpers.cpp \
     ../src/AssemblerPrivate/ProcessIoLine.cpp \
     ../src/AssemblerPrivate/make_generic_instructions.cpp \
+    ../src/GpuPrivate/SpriteBlitter.cpp \
+    ../src/ApuPrivate/NoteCache.cpp \
+    ../src/ApuPrivate/NoiseLfsr.cpp \
     ../src/Debugger.cpp \
     ../src/ErfiConsole.cpp \
+    ../src/BatchRunner.cpp \
+    ../src/FrameRecorder.cpp \
+    ../src/WavWriter.cpp \
     ../src/ErfiApu.cpp \
     ../src/tests.cpp \
     ../src/parse_program_options.cpp
@@ -31,15 +37,22 @@ HEADERS += \
     ../src/ErfiCpu.hpp \
     ../src/ErfiError.hpp \
     ../src/StringUtil.hpp \
+    ../src/SpscRing.hpp \
     ../src/AssemblerPrivate/TextProcessState.hpp \
     ../src/AssemblerPrivate/GetLineProcessingFunction.hpp \
     ../src/AssemblerPrivate/LineParsingHelpers.hpp \
     ../src/AssemblerPrivate/CommonDefinitions.hpp \
     ../src/AssemblerPrivate/ProcessIoLine.hpp \
     ../src/AssemblerPrivate/make_generic_instructions.hpp \
+    ../src/GpuPrivate/SpriteBlitter.hpp \
+    ../src/ApuPrivate/NoteCache.hpp \
+    ../src/ApuPrivate/NoiseLfsr.hpp \
     ../src/Debugger.hpp \
     ../src/ErfiGamePad.hpp \
     ../src/ErfiConsole.hpp \
+    ../src/BatchRunner.hpp \
+    ../src/FrameRecorder.hpp \
+    ../src/WavWriter.hpp \
     ../src/ErfiApu.hpp \
     ../src/tests.hpp \
     ../src/parse_program_options.hpp
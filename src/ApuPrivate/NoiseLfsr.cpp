@@ -0,0 +1,109 @@
+/****************************************************************************
+
+    File: NoiseLfsr.cpp
+    Author: Andrew Janke
+    License: GPLv3
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*****************************************************************************/
+
+#include "NoiseLfsr.hpp"
+
+#include <algorithm>
+#include <vector>
+
+#include <cassert>
+
+namespace {
+
+constexpr const int REGISTER_BITS = 15;
+constexpr const erfin::UInt16 REGISTER_MASK = (1 << REGISTER_BITS) - 1;
+
+} // end of <anonymous> namespace
+
+namespace erfin {
+
+constexpr /* static */ const UInt16 NoiseLfsr::DEFAULT_SEED;
+
+NoiseLfsr::NoiseLfsr(UInt16 seed_):
+    m_state(DEFAULT_SEED),
+    m_mode(NoiseMode::LONG_PERIOD)
+{ seed(seed_); }
+
+void NoiseLfsr::seed(UInt16 seed_) {
+    m_state = UInt16(seed_ & REGISTER_MASK);
+    if (m_state == 0) m_state = DEFAULT_SEED;
+}
+
+void NoiseLfsr::step() {
+    auto feedback = (m_state ^ (m_state >> tap())) & 1;
+    m_state = UInt16((m_state >> 1) | (feedback << (REGISTER_BITS - 1)));
+}
+
+void NoiseLfsr::fill(Int16 * samples, std::size_t count, Int16 amplitude) {
+    // n clocks at once: the i-th feedback bit only depends on bits i and
+    // i + tap of the register as it is now, so long as i + tap is under
+    // fifteen
+    const auto tap_ = tap();
+    const auto steps_at_once = std::size_t(REGISTER_BITS - tap_);
+    while (count != 0) {
+        auto n = std::min(count, steps_at_once);
+        UInt32 bits = m_state;
+        UInt32 feedback = (bits ^ (bits >> tap_)) & ((1u << n) - 1);
+        m_state = UInt16((bits >> n) | (feedback << (REGISTER_BITS - int(n))));
+        for (std::size_t i = 0; i != n; ++i)
+            samples[i] = ((bits >> i) & 1) ? Int16(-amplitude) : amplitude;
+        samples += n;
+        count   -= n;
+    }
+}
+
+/* static */ void NoiseLfsr::run_tests() {
+    // the long period visits every non-zero state, the short one only 93
+    // (starting from one)
+    for (auto mode : { NoiseMode::LONG_PERIOD, NoiseMode::SHORT_PERIOD }) {
+        NoiseLfsr lfsr;
+        lfsr.set_mode(mode);
+        int period = 0;
+        do {
+            lfsr.step();
+            ++period;
+        } while (lfsr.state() != DEFAULT_SEED);
+        assert(period == (mode == NoiseMode::LONG_PERIOD ? 32767 : 93));
+        (void)period;
+    }
+    // clocking several at a time gives the same output as one at a time
+    for (auto mode : { NoiseMode::LONG_PERIOD, NoiseMode::SHORT_PERIOD }) {
+        NoiseLfsr stepped(0x1234), filled(0x1234);
+        stepped.set_mode(mode);
+        filled .set_mode(mode);
+        std::vector<Int16> samples(1000);
+        for (std::size_t count : { 1, 3, 8, 9, 14, 15, 100 }) {
+            filled.fill(samples.data(), count, 100);
+            for (std::size_t i = 0; i != count; ++i) {
+                Int16 expected = (stepped.state() & 1) ? -100 : 100;
+                assert(samples[i] == expected);
+                stepped.step();
+                (void)expected;
+            }
+            assert(stepped.state() == filled.state());
+        }
+    }
+    // zero would lock up
+    assert(NoiseLfsr(0).state() == DEFAULT_SEED);
+    assert(NoiseLfsr(0x8000).state() == DEFAULT_SEED);
+}
+
+} // end of erfin namespace
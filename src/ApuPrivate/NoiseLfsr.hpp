@@ -0,0 +1,77 @@
+/****************************************************************************
+
+    File: NoiseLfsr.hpp
+    Author: Andrew Janke
+    License: GPLv3
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*****************************************************************************/
+
+#ifndef MACRO_HEADER_GUARD_APU_PRIVATE_NOISE_LFSR_HPP
+#define MACRO_HEADER_GUARD_APU_PRIVATE_NOISE_LFSR_HPP
+
+#include "../ErfiDefs.hpp"
+
+#include <cstdint>
+
+namespace erfin {
+
+/** @brief The noise channel's 15-bit linear feedback shift register, after
+ *         the NES's.
+ *
+ *  Each clock shifts the register right by one, feeding bit zero XOR the tap
+ *  (bit one for the long period, bit six for the short) into bit fourteen.
+ *  Bit zero is the output.
+ */
+class NoiseLfsr {
+public:
+    using Int16 = std::int16_t;
+
+    static constexpr const UInt16 DEFAULT_SEED = 1;
+
+    explicit NoiseLfsr(UInt16 seed = DEFAULT_SEED);
+
+    /** Only the low fifteen bits are used, a register of zeros never
+     *  changes, so zero is taken as the default seed.
+     */
+    void seed(UInt16);
+
+    void set_mode(NoiseMode mode) { m_mode = mode; }
+
+    NoiseMode mode() const { return m_mode; }
+
+    UInt16 state() const { return m_state; }
+
+    /** Clocks the register once. */
+    void step();
+
+    /** Clocks the register once for each sample, writing -amplitude for each
+     *  set output bit and amplitude otherwise. Clocks several times at once,
+     *  as many as there are bits above the tap.
+     */
+    void fill(Int16 * samples, std::size_t count, Int16 amplitude);
+
+    static void run_tests();
+
+private:
+    int tap() const { return m_mode == NoiseMode::LONG_PERIOD ? 1 : 6; }
+
+    UInt16 m_state;
+    NoiseMode m_mode;
+};
+
+} // end of erfin namespace
+
+#endif
@@ -0,0 +1,119 @@
+/****************************************************************************
+
+    File: NoteCache.cpp
+    Author: Andrew Janke
+    License: GPLv3
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*****************************************************************************/
+
+#include "NoteCache.hpp"
+
+#include <algorithm>
+
+#include <cassert>
+
+namespace erfin {
+
+bool NoteCache::Key::operator == (const Key & rhs) const {
+    return channel == rhs.channel && pitch == rhs.pitch &&
+           tempo == rhs.tempo && duty_cycle_window == rhs.duty_cycle_window;
+}
+
+constexpr /* static */ const std::size_t NoteCache::DEFAULT_CAPACITY;
+
+NoteCache::NoteCache(std::size_t capacity):
+    m_size(0),
+    m_capacity(capacity)
+{}
+
+const std::vector<NoteCache::Int16> * NoteCache::find(const Key & key) {
+    auto itr = m_index.find(key);
+    if (itr == m_index.end()) return nullptr;
+    // moving the entry leaves every iterator to it valid
+    m_entries.splice(m_entries.begin(), m_entries, itr->second);
+    return &itr->second->samples;
+}
+
+void NoteCache::insert(const Key & key, const Int16 * samples, std::size_t count) {
+    if (count > m_capacity) return;
+    auto itr = m_index.find(key);
+    if (itr != m_index.end()) {
+        m_size -= itr->second->samples.size();
+        m_entries.erase(itr->second);
+        m_index.erase(itr);
+    }
+    // evicted buffers are reused for the new note
+    std::vector<Int16> buffer;
+    while (m_size + count > m_capacity) {
+        auto & lru = m_entries.back();
+        m_size -= lru.samples.size();
+        m_index.erase(lru.key);
+        buffer.swap(lru.samples);
+        m_entries.pop_back();
+    }
+    buffer.assign(samples, samples + count);
+    m_entries.push_front(Entry { key, std::vector<Int16>() });
+    m_entries.front().samples.swap(buffer);
+    m_index[key] = m_entries.begin();
+    m_size += count;
+}
+
+/* static */ void NoteCache::run_tests() {
+    const std::vector<Int16> short_note = { 1, 2, 3 };
+    const std::vector<Int16> long_note(8, 4);
+    auto make_key = [](int pitch) { return Key { Channel::TRIANGLE, pitch, 8, 0 }; };
+
+    NoteCache cache(16);
+    assert(!cache.find(make_key(1)));
+    cache.insert(make_key(1), short_note.data(), short_note.size());
+    cache.insert(make_key(2), long_note.data(), long_note.size());
+    assert(*cache.find(make_key(1)) == short_note);
+    assert(cache.size() == 11 && cache.note_count() == 2);
+
+    // keys differing in any part are different notes
+    assert(!cache.find(Key { Channel::PULSE_ONE, 1, 8, 0 }));
+    assert(!cache.find(Key { Channel::TRIANGLE , 1, 9, 0 }));
+    assert(!cache.find(Key { Channel::TRIANGLE , 1, 8, 1 }));
+
+    // note 1 was used more recently, so note 2 goes to make room
+    cache.insert(make_key(3), long_note.data(), long_note.size());
+    assert(!cache.find(make_key(2)));
+    assert(cache.find(make_key(1)) && cache.find(make_key(3)));
+    assert(cache.size() == 11);
+
+    // replacing a note does not count it twice
+    cache.insert(make_key(3), short_note.data(), short_note.size());
+    assert(*cache.find(make_key(3)) == short_note);
+    assert(cache.size() == 6 && cache.note_count() == 2);
+
+    // too big to ever fit
+    std::vector<Int16> huge_note(17, 5);
+    cache.insert(make_key(4), huge_note.data(), huge_note.size());
+    assert(!cache.find(make_key(4)));
+    assert(cache.size() == 6);
+}
+
+/* private */ std::size_t NoteCache::KeyHasher::operator () (const Key & key) const {
+    std::size_t hash = std::size_t(key.channel);
+    for (auto part : { std::size_t(key.pitch), std::size_t(key.tempo),
+                       std::size_t(key.duty_cycle_window) })
+    {
+        hash = hash*31 + part;
+    }
+    return hash;
+}
+
+} // end of erfin namespace
@@ -0,0 +1,99 @@
+/****************************************************************************
+
+    File: NoteCache.hpp
+    Author: Andrew Janke
+    License: GPLv3
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*****************************************************************************/
+
+#ifndef MACRO_HEADER_GUARD_APU_PRIVATE_NOTE_CACHE_HPP
+#define MACRO_HEADER_GUARD_APU_PRIVATE_NOTE_CACHE_HPP
+
+#include "../ErfiDefs.hpp"
+
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+#include <cstdint>
+
+namespace erfin {
+
+/** @brief Bounded cache of notes already synthesized, the least recently
+ *         used are evicted first.
+ *
+ *  Music tends to play the same few notes over and over, so a note is
+ *  synthesized once, and copied from the cache each time after.
+ */
+class NoteCache {
+public:
+    using Int16 = std::int16_t;
+
+    /** Everything a note's samples depend on. */
+    struct Key {
+        Channel channel; // both pulse channels sound the same, and should
+                         // use PULSE_ONE
+        int pitch;
+        int tempo;       // in samples
+        UInt32 duty_cycle_window;
+
+        bool operator == (const Key &) const;
+    };
+
+    /** Default most samples held, over every note. */
+    static constexpr const std::size_t DEFAULT_CAPACITY = 1 << 18;
+
+    explicit NoteCache(std::size_t capacity = DEFAULT_CAPACITY);
+
+    /** @return the note's samples, or nullptr if it is not cached, the
+     *          pointer is good until the next insert
+     */
+    const std::vector<Int16> * find(const Key &);
+
+    /** Caches a copy of the note, evicting the least recently used notes
+     *  until it fits. A note larger than the whole cache is not kept.
+     */
+    void insert(const Key &, const Int16 * samples, std::size_t count);
+
+    /** @return samples held, over every note */
+    std::size_t size() const { return m_size; }
+
+    std::size_t note_count() const { return m_index.size(); }
+
+    static void run_tests();
+
+private:
+    struct KeyHasher {
+        std::size_t operator () (const Key &) const;
+    };
+
+    struct Entry {
+        Key key;
+        std::vector<Int16> samples;
+    };
+
+    // most recently used at the front
+    using EntryList = std::list<Entry>;
+
+    EntryList m_entries;
+    std::unordered_map<Key, EntryList::iterator, KeyHasher> m_index;
+    std::size_t m_size;
+    std::size_t m_capacity;
+};
+
+} // end of erfin namespace
+
+#endif
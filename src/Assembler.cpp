@@ -35,20 +35,14 @@
 
 namespace {
 
-using StringCIter = std::vector<std::string>::const_iterator;
 using UInt32 = erfin::UInt32;
 using Error = std::runtime_error;
 using SuffixAssumption = erfin::Assembler::Assumption;
 using TextProcessState = erfin::TextProcessState;
+using TokensContainer = erfin::TokensContainer;
 
 // high level textual processing
-std::vector<std::string> seperate_into_lines(const std::string & str);
-
-void remove_comments_from(std::string & str);
-
-std::vector<std::string> tokenize(const std::vector<std::string> & lines);
-
-void convert_to_lower_case(std::string & str);
+TokensContainer tokenize(const std::string & source);
 
 int get_file_size(const char * filename);
 
@@ -75,8 +69,7 @@ void Assembler::assemble_from_stream(std::istream & in) {
 }
 
 void Assembler::assemble_from_string(const std::string & source) {
-    std::string temp = source;
-    assemble_from_work_string(temp);
+    assemble_from_work_string(source);
 }
 
 void Assembler::print_warnings(std::ostream & out) const {
@@ -93,14 +86,12 @@ void Assembler::setup_debugger(Debugger & dbgr) const {
         (m_inst_to_line_map, dbgr);
 }
 
-/* private */ void Assembler::assemble_from_work_string(std::string & source) {
+/* private */ void Assembler::assemble_from_work_string
+    (const std::string & source)
+{
     m_program.clear();
-    convert_to_lower_case(source);
-    std::vector<std::string> line_list = seperate_into_lines(source);
-    for (std::string & line : line_list)
-        remove_comments_from(line);
-    // I need some means to sync line numbers with the source code
-    std::vector<std::string> tokens = tokenize(line_list);
+    // tokens are views into the source, which outlives them here
+    TokensContainer tokens = tokenize(source);
 
     TextProcessState tpstate;
 
@@ -126,99 +117,49 @@ std::size_t Assembler::translate_to_line_number
 
 namespace {
 
-std::vector<std::string> seperate_into_lines(const std::string & str) {
-    std::vector<std::string> rv;
-    auto old_pos = str.begin();
-    auto itr = str.begin();
-    for (; itr != str.end(); ++itr) {
+TokensContainer tokenize(const std::string & source) {
+    // one pass over the source: comments are skipped, each '\n' and '\r'
+    // ends a line (and so is a newline token), ':', '[' and ']' are tokens of
+    // their own and end any word before them
+    static const char * const NEWLINE = "\n";
+    TokensContainer tokens;
+    const char * const end = source.data() + source.size();
+    const char * word = nullptr; // start of the current word, if in one
+    auto end_word = [&tokens, &word](const char * itr) {
+        if (!word) return;
+        tokens.emplace_back(word, std::size_t(itr - word));
+        word = nullptr;
+    };
+    for (const char * itr = source.data(); itr != end; ++itr) {
         switch (*itr) {
-        case '\n': case '\r':
-            rv.push_back(std::string());
-            rv.back().insert(rv.back().begin(), old_pos, itr);
-            old_pos = itr + 1;
-            break;
-        default: break;
-        }
-    }
-    if (itr != old_pos && old_pos != str.end()) {
-        rv.push_back(std::string());
-        rv.back().insert(rv.back().begin(), old_pos, itr);
-    }
-    return rv;
-}
-
-void remove_comments_from(std::string & str) {
-    bool overwrite_until_end = false;
-    for (char & c : str) {
-        switch (c) {
         case '#':
-            overwrite_until_end = true;
+            end_word(itr);
+            while (itr + 1 != end && itr[1] != '\n' && itr[1] != '\r')
+                ++itr;
             break;
         case '\n': case '\r':
-            overwrite_until_end = false;
+            end_word(itr);
+            tokens.emplace_back(NEWLINE);
+            break;
+        case ' ': case '\t':
+            end_word(itr);
+            break;
+        case ':': case '[': case ']':
+            end_word(itr);
+            tokens.emplace_back(itr, 1);
             break;
         default:
-            if (overwrite_until_end)
-                c = '#';
+            if (!word) word = itr;
             break;
         }
     }
-    str.erase(std::remove(str.begin(), str.end(), '#'), str.end());
-}
-
-std::vector<std::string> tokenize(const std::vector<std::string> & lines) {
-    std::vector<std::string> tokens;
-    for (const std::string & str : lines) {
-        auto old_pos = str.end();
-        auto itr = str.begin();
-        for (; itr != str.end(); ++itr) {
-            // check for end of words
-            if (old_pos != str.end()) {
-                switch (*itr) {
-                case ':': case ' ': case '\t': case ']':
-                    tokens.push_back(std::string { old_pos, itr });
-                    old_pos = str.end();
-                    break;
-                default: break;
-                }
-            }
-
-            switch (*itr) {
-            // label declarations
-            // "operators" :[]
-            case ':': case '[': case ']':
-                // operators are fickle creatures
-                tokens.push_back(std::string { *itr });
-                break;
-            case '\n': case '\r':
-                std::cerr << "tokenize: FATAL: Program logic error: Should not "
-                             "see newline chars at this stage." << std::endl;
-                std::terminate();
-            case ' ': case '\t': break;
-            default:
-                if (old_pos == str.end())
-                    old_pos = itr;
-                break;
-            }
-        }
-        if (old_pos != str.end()) {
-            tokens.push_back(std::string { old_pos, itr });
-        }
-
-        tokens.push_back("\n");
-    }
+    end_word(end);
+    // the last line need not end with a newline
+    if (!source.empty() && source.back() != '\n' && source.back() != '\r')
+        tokens.emplace_back(NEWLINE);
     return tokens;
 }
 
-void convert_to_lower_case(std::string & str) {
-    static_assert(int('a') > int('A'), "");
-    static constexpr char TO_LOWER_DIFF = char('a' - 'A');
-    for (char & c : str) {
-        if (c >= 'A' && c <= 'Z')
-            c = char(c + TO_LOWER_DIFF);
-    }
-}
-
 // <---------------------------- level 2 helpers ----------------------------->
 
 int get_file_size(const char * filename) {
@@ -79,7 +79,7 @@ public:
     static void run_tests();
 
 private:
-    void assemble_from_work_string(std::string & source);
+    void assemble_from_work_string(const std::string & source);
 
     ProgramData m_program;
 
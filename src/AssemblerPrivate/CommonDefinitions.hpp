@@ -25,9 +25,67 @@
 #include <vector>
 #include <string>
 
+#include <cstring>
+
 namespace erfin {
 
-using TokensContainer = std::vector<std::string>;
+/** @brief One token of the source code, a view into the source rather than
+ *         a copy of it (the source must outlive its tokens).
+ *
+ *  The source keeps its case, everything the assembler compares tokens with
+ *  is lower case, so tokens are lowered a character at a time as they are
+ *  compared. Newlines are tokens too, the line number of any token is the
+ *  number of newline tokens before it.
+ */
+class Token {
+public:
+    Token(): m_text(""), m_length(0) {}
+
+    Token(const char * text, std::size_t length):
+        m_text(text), m_length(length) {}
+
+    /** For tokens which are not in the source (like newlines), the text
+     *  must outlive the token.
+     */
+    /* implicit */ Token(const char * text):
+        m_text(text), m_length(std::strlen(text)) {}
+
+    /** @return text as it appears in the source */
+    const char * data() const { return m_text; }
+
+    std::size_t size() const { return m_length; }
+
+    /** @return i-th character in lower case */
+    char operator [] (std::size_t i) const { return to_lower(m_text[i]); }
+
+    /** @param rhs must be lower case */
+    bool operator == (const char * rhs) const {
+        for (std::size_t i = 0; i != m_length; ++i) {
+            if (rhs[i] == '\0' || to_lower(m_text[i]) != rhs[i]) return false;
+        }
+        return rhs[m_length] == '\0';
+    }
+
+    bool operator != (const char * rhs) const { return !(*this == rhs); }
+
+    /** @return copy of the text in lower case, for error messages and label
+     *          names
+     */
+    std::string to_string() const {
+        std::string rv(m_text, m_length);
+        for (char & c : rv) c = to_lower(c);
+        return rv;
+    }
+
+    static char to_lower(char c)
+        { return (c >= 'A' && c <= 'Z') ? char(c - 'A' + 'a') : c; }
+
+private:
+    const char * m_text;
+    std::size_t m_length;
+};
+
+using TokensContainer = std::vector<Token>;
 using TokensConstIterator = TokensContainer::const_iterator;
 
 } // end of erfin namespace
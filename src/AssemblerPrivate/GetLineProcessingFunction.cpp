@@ -112,13 +112,14 @@ StringCIter make_pop(TextProcessState &, StringCIter, StringCIter);
 namespace erfin {
 
 LineToInstFunc get_line_processing_function
-    (Assembler::Assumption assumptions, const std::string & fname)
+    (Assembler::Assumption assumptions, const Token & fname)
 {
     using LineFuncMap = std::map<std::string, LineToInstFunc>;
     static bool is_initialized = false;
     static LineFuncMap fmap;
     if (is_initialized) {
-        auto itr = fmap.find(fname);
+        // (names are short enough to not allocate)
+        auto itr = fmap.find(fname.to_string());
         return (itr == fmap.end()) ? nullptr : itr->second;
     }
 
@@ -363,7 +364,7 @@ StringCIter make_skip
 
     auto string_to_int_immd = [] (StringCIter itr) -> Immd {
         int i;
-        bool b = string_to_number(itr->begin(),itr->end(), i);
+        bool b = string_to_number(itr->data(), itr->data() + itr->size(), i);
         assert(b); (void)b;
         return encode_immd_int(i);
     };
@@ -420,7 +421,7 @@ StringCIter make_set
     auto itr2reg = [](StringCIter itr) -> Reg { return string_to_register(*itr); };
     Inst inst;
     NumericParseInfo npi;
-    const std::string * label = nullptr;
+    const Token * label = nullptr;
     switch (get_lines_param_form(beg, line_end, &npi)) {
     case XPF_2R:
         inst = encode(OpCode::SET, itr2reg(beg), itr2reg(beg + 1));
@@ -465,7 +466,7 @@ StringCIter make_jump
     Inst inst;
     ParamForm pf;
     NumericParseInfo npi;
-    const std::string * label = nullptr;
+    const Token * label = nullptr;
 
     switch (get_lines_param_form(beg, eol, &npi)) {
     case XPF_1R:
@@ -512,7 +513,8 @@ StringCIter assume_directive
         {
             state.include_assumption(Assembler::SAVE_AND_RESTORE_REGISTERS);
         } else {
-            throw state.make_error(": \"" + *beg + "\" is not a valid assumption.");
+            throw state.make_error(": \"" + beg->to_string() +
+                                   "\" is not a valid assumption.");
         }
     } else {
         throw state.make_error(": too many assumptions/arguments.");
@@ -643,7 +645,7 @@ void run_get_line_processing_function_tests() {
     TextProcessState state;
     // test basic instructions
     {
-    const std::vector<std::string> sample_code = {
+    const TokensContainer sample_code = {
         "="  , "x", "y"    , "\n",
         "set", "x", "1234" , "\n",
         "="  , "x", "12.34"
@@ -660,7 +662,7 @@ void run_get_line_processing_function_tests() {
     }
     // test that "generic arthemetic" instruction maker functions
     {
-    const std::vector<std::string> sample_code = {
+    const TokensContainer sample_code = {
         "add", "x", "y", "\n",
         "and", "x", "y", "a", "\n",
         "-"  , "x", "123"
@@ -675,7 +677,7 @@ void run_get_line_processing_function_tests() {
     (void)supposed_top;
     }
     {
-    const std::vector<std::string> sample_code = {
+    const TokensContainer sample_code = {
         ">>", "x", "9384", "\n",
         ">>", "z", "\n",
         "<<", "y", "a", "\n",
@@ -691,7 +693,7 @@ void run_get_line_processing_function_tests() {
     (void)supposed_top;
     }
     {
-    const std::vector<std::string> sample_code = {
+    const TokensContainer sample_code = {
         "assume", "integer", "\n",
         "<>=", "x", "y", "\n",
         "?", "x", "1"
@@ -707,7 +709,7 @@ void run_get_line_processing_function_tests() {
     // test unfulfilled labels!
     {
     state = TextProcessState();
-    const std::vector<std::string> sample_code = {
+    const TokensContainer sample_code = {
         "=" , "pc", "label1", "\n",
         ">>", "x", "label2", "\n",
         ":", "label1", ":", "label2", "+", "x", "y", "\n",
@@ -742,6 +744,22 @@ void run_get_line_processing_function_tests() {
     (void)pdata;
     }
     {
+    // case is ignored, and comments do not upset line numbers
+    constexpr const char * const sample_code =
+        "     SET X 0X1F # Comment\n"
+        ":Loop\n"
+        "     = pc LOOP\n"
+        "     = Y 1.5";
+    Assembler asmr;
+    asmr.assemble_from_string(sample_code);
+    const auto & pdata = asmr.program_data();
+    assert(pdata[0] == encode(OpCode::SET, Reg::X , encode_immd_int(31)));
+    assert(pdata[1] == encode(OpCode::SET, Reg::PC, encode_immd_int(1)));
+    assert(pdata[2] == encode(OpCode::SET, Reg::Y , encode_immd_fp(1.5)));
+    assert(asmr.translate_to_line_number(1) == 3);
+    (void)pdata;
+    }
+    {
     constexpr const char * const sample_code =
         "io upload x y z a";
     Assembler asmr;
@@ -51,17 +51,19 @@ const char * extended_param_form_to_string(ExtendedParamForm xpf) {
     }
 }
 
-NumericParseInfo parse_number(const std::string & str) {
+NumericParseInfo parse_number(const Token & str) {
     NumericParseInfo rv;
     // first try to find a prefex
     auto str_has_at = [&str] (char c, std::size_t idx) -> bool {
         if (idx >= str.size()) return false;
-        return tolower(str[idx]) == c;
+        return str[idx] == c;
     };
     bool neg = str_has_at('-', 0);
     bool zero_prefixed = str_has_at('0', neg ? 1 : 0);
     int  base;
-    auto beg = str.begin();
+    // string_to_number takes digits of either case
+    auto beg = str.data();
+    const auto str_end = str.data() + str.size();
     if (zero_prefixed && str_has_at('x', neg ? 2 : 1)) {
         beg += (neg ? 3 : 2);
         base = 16;
@@ -75,15 +77,16 @@ NumericParseInfo parse_number(const std::string & str) {
     }
 
     bool has_dot = false;
-    for (char c : str) has_dot = (c == '.') ? true : has_dot; // n.-
+    for (auto itr = beg; itr != str_end; ++itr)
+        has_dot = (*itr == '.') ? true : has_dot; // n.-
     if (has_dot) {
-        if (string_to_number(beg, str.end(), rv.floating_point, double(base))) {
+        if (string_to_number(beg, str_end, rv.floating_point, double(base))) {
             if (neg) rv.floating_point *= -1.0;
             rv.type = DECIMAL;
             return rv;
         }
     } else {
-        if (string_to_number(beg, str.end(), rv.integer, base)) {
+        if (string_to_number(beg, str_end, rv.integer, base)) {
             if (neg) rv.integer *= -1;
             rv.type = INTEGER;
             return rv;
@@ -93,15 +96,8 @@ NumericParseInfo parse_number(const std::string & str) {
     return rv;
 }
 
-erfin::Reg string_to_register(const std::string & str) {
+erfin::Reg string_to_register(const Token & str) {
     using namespace erfin;
-    static_assert(sizeof(char)*2 == sizeof(UInt16)               ,
-                  "string_to_register Implementation must change");
-    auto first2eq = [](const char * lhs, const char * rhs) {
-        return *reinterpret_cast<const UInt16 *>(lhs) ==
-               *reinterpret_cast<const UInt16 *>(rhs);
-    };
-
     switch (str.size()) {
     case 1: switch (str[0]) {
         case 'x': return Reg::X    ;
@@ -112,19 +108,21 @@ erfin::Reg string_to_register(const std::string & str) {
         case 'c': return Reg::C    ;
         default : return Reg::COUNT;
         }
-    case 2: if (first2eq(str.c_str(), "pc")) return Reg::PC;
-            if (first2eq(str.c_str(), "sp")) return Reg::SP;
+    case 2: if (str == "pc") return Reg::PC;
+            if (str == "sp") return Reg::SP;
             return Reg::COUNT;
     default: return Reg::COUNT;
     }
 }
 
 Reg string_to_register_or_throw
-    (TextProcessState & state, const std::string & reg_str)
+    (TextProcessState & state, const Token & reg_str)
 {
     auto rv = string_to_register(reg_str);
-    if (rv == Reg::COUNT)
-        throw state.make_error(": \"" + reg_str + "\" is not a valid register.");
+    if (rv == Reg::COUNT) {
+        throw state.make_error(": \"" + reg_str.to_string() +
+                               "\" is not a valid register.");
+    }
     return rv;
 }
 
@@ -72,7 +72,7 @@ struct NumericParseInfo {
 
 const char * extended_param_form_to_string(ExtendedParamForm xpf);
 
-NumericParseInfo parse_number(const std::string & str);
+NumericParseInfo parse_number(const Token & str);
 
 TokensConstIterator get_eol(TokensConstIterator beg, TokensConstIterator end);
 
@@ -80,10 +80,10 @@ ExtendedParamForm get_lines_param_form
     (TokensConstIterator beg, TokensConstIterator end,
      NumericParseInfo * npi = nullptr);
 
-Reg string_to_register(const std::string & str);
+Reg string_to_register(const Token & str);
 
 Reg string_to_register_or_throw
-    (TextProcessState & state, const std::string & reg_str);
+    (TextProcessState & state, const Token & reg_str);
 
 template <typename T, typename Head, typename ... Types>
 bool equal_to_any(T primary, Head head, Types ... args);
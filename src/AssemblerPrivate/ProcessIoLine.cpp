@@ -25,6 +25,7 @@
 
 #include <map>
 #include <string>
+#include <vector>
 
 #include <cassert>
 
@@ -39,6 +40,9 @@ StringCIter make_io_apu_inst    (TextProcessState &, StringCIter, StringCIter);
 StringCIter make_io_upload      (TextProcessState &, StringCIter, StringCIter);
 StringCIter make_io_clear_screen(TextProcessState &, StringCIter, StringCIter);
 StringCIter make_io_draw        (TextProcessState &, StringCIter, StringCIter);
+StringCIter make_io_draw_list   (TextProcessState &, StringCIter, StringCIter);
+StringCIter make_io_tile_map    (TextProcessState &, StringCIter, StringCIter);
+StringCIter make_io_tile_scroll (TextProcessState &, StringCIter, StringCIter);
 StringCIter make_io_halt        (TextProcessState &, StringCIter, StringCIter);
 StringCIter make_io_wait        (TextProcessState &, StringCIter, StringCIter);
 
@@ -69,6 +73,9 @@ StringCIter make_sysio
     // io upload x y z # <- turns into three save instructions
     // io clear # screen
     // io draw x y z
+    // io draw-list x y # <- address and count of (x, y, index) records
+    // io tile-map x y z # <- address, width, height of the background
+    // io tile-scroll x y
     // io halt
     //
     // io read null       x # <- your "null pointer"
@@ -81,6 +88,7 @@ StringCIter make_sysio
     // io triangle/pulse one/pulse two/noise play x/IMMD
     // io ... tempo x/IMMD # notes per second
     // io ... duty  x      # for entire window
+    // io noise mode x/IMMD # 0 long period, 1 short
 
     using LineFuncMap = std::map<std::string, LineToInstFunc>;
     static bool is_initialized = false;
@@ -88,10 +96,10 @@ StringCIter make_sysio
 
     if (is_initialized) {
         ++beg;
-        auto itr = fmap.find(*beg);
+        auto itr = fmap.find(beg->to_string());
         if (itr == fmap.end()) {
             throw state.make_error(": io contains no sub operation \"" +
-                                   *beg + "\"."                         );
+                                   beg->to_string() + "\".");
         }
         if (state.last_instruction_was(OpCode::SKIP)) {
             state.push_warning(": \"io\" is a pseudo-instruction following a "
@@ -107,6 +115,9 @@ StringCIter make_sysio
     fmap["upload"] = make_io_upload;
     fmap["clear" ] = make_io_clear_screen;
     fmap["draw"  ] = make_io_draw;
+    fmap["draw-list"  ] = make_io_draw_list;
+    fmap["tile-map"   ] = make_io_tile_map;
+    fmap["tile-scroll"] = make_io_tile_scroll;
     fmap["halt"  ] = make_io_halt;
     fmap["wait"  ] = make_io_wait;
 
@@ -147,9 +158,13 @@ void run_make_sysio_tests() {
         "io triangle note x 100\n"
         "io pulse two duty-cycle-window x\n"
         "io noise note x 900 800 700 600 500 400 300 200 100\n"
+        "io noise mode x 1\n"
         "io upload x y z a\n"
         "io clear x\n"
         "io draw x y z\n"
+        "io draw-list x y\n"
+        "io tile-map x y z\n"
+        "io tile-scroll x y\n"
         "io wait x\n"
         "io halt y\n"
         "io upload x y x z # should emit a warning\n"
@@ -166,6 +181,12 @@ namespace {
 void emit_set_aside_register_instructions
     (TextProcessState & state, UInt32 device_address, int command_identity, Reg scape_goat_reg);
 
+// gpu command whose parameters are all registers, the first is used to send
+// the command identity
+StringCIter emit_gpu_command
+    (TextProcessState & state, StringCIter beg, StringCIter end,
+     GpuOpCode code, const char * wrong_argument_count_msg);
+
 void emit_ait_prelude(TextProcessState & state, Reg reg, Channel channel, ApuInstructionType ait);
 
 ApuInstructionType iterator_to_apu_inst_type(TextProcessState & state, StringCIter itr);
@@ -191,7 +212,8 @@ StringCIter make_io_read
     else if (*beg == "random"    ) source_address = RANDOM_NUMBER_GENERATOR;
     else if (*beg == "gpu"       ) source_address = GPU_RESPONSE           ;
     else if (*beg == "bus-error" ) source_address = BUS_ERROR              ;
-    else throw state.make_error(": \"" + *beg + "\" is not a valid source.");
+    else throw state.make_error(": \"" + beg->to_string() +
+                                "\" is not a valid source.");
 
     if (eol - ++beg < 1) {
         throw state.make_error(": no parameters were given, read expects at "
@@ -237,7 +259,7 @@ StringCIter make_io_apu_inst
     for (; beg != eol; ++beg) {
         Immd immd;
         NumericParseInfo npi = parse_number(*beg);
-        const std::string * label = nullptr;
+        const Token * label = nullptr;
         switch (npi.type) {
         case INTEGER:
             immd = encode_immd_int(npi.integer);
@@ -336,6 +358,31 @@ StringCIter make_io_draw
     return eol;
 }
 
+StringCIter make_io_draw_list
+    (TextProcessState & state, StringCIter beg, StringCIter end)
+{
+    // the records themselves are read by the gpu
+    return emit_gpu_command(state, beg, end, gpu_enum_types::DRAW_LIST,
+        ": draw-list expects exactly two arguments: the address of the "
+        "first record, and the number of records.");
+}
+
+StringCIter make_io_tile_map
+    (TextProcessState & state, StringCIter beg, StringCIter end)
+{
+    return emit_gpu_command(state, beg, end, gpu_enum_types::TILE_MAP,
+        ": tile-map expects exactly three arguments: the address of the "
+        "map, and its width and height in tiles.");
+}
+
+StringCIter make_io_tile_scroll
+    (TextProcessState & state, StringCIter beg, StringCIter end)
+{
+    return emit_gpu_command(state, beg, end, gpu_enum_types::TILE_SCROLL,
+        ": tile-scroll expects exactly two arguments: the x and y position "
+        "of the map at the top left of the screen.");
+}
+
 StringCIter make_io_halt
     (TextProcessState & state, StringCIter beg, StringCIter end)
 {
@@ -402,6 +449,28 @@ void emit_set_aside_register_instructions
     state.add_instruction(encode(OpCode::MINUS, Reg::SP, Reg::SP, encode_immd_int(1)));
 }
 
+StringCIter emit_gpu_command
+    (TextProcessState & state, StringCIter beg, StringCIter end,
+     GpuOpCode code, const char * wrong_argument_count_msg)
+{
+    using namespace erfin;
+    auto eol = get_eol(++beg, end);
+    if (eol - beg != parameters_per_instruction(code))
+        throw state.make_error(wrong_argument_count_msg);
+    std::vector<Reg> args;
+    for (; beg != eol; ++beg)
+        args.push_back(string_to_register_or_throw(state, *beg));
+
+    static constexpr const auto GPU_INPUT_STREAM = device_addresses::GPU_INPUT_STREAM;
+    emit_set_aside_register_instructions
+        (state, GPU_INPUT_STREAM, code, args.front());
+    for (const Reg & arg : args) {
+        state.add_instruction( encode(OpCode::SAVE,                arg,
+                                      encode_immd_addr(GPU_INPUT_STREAM)) );
+    }
+    return eol;
+}
+
 void emit_ait_prelude(TextProcessState & state, Reg reg, Channel channel, ApuInstructionType ait) {
     const auto apu_strm_address = encode_immd_addr(device_addresses::APU_INPUT_STREAM);
     state.add_instruction(encode(OpCode::SET, reg, encode_immd_int(static_cast<int>(channel))));
@@ -419,8 +488,10 @@ ApuInstructionType iterator_to_apu_inst_type
         return ApuInstructionType::TEMPO;
     } else if (*itr == "duty-cycle-window") {
         return ApuInstructionType::DUTY_CYCLE_WINDOW;
+    } else if (*itr == "mode") {
+        return ApuInstructionType::NOISE_MODE;
     } else {
-        throw state.make_error(": channel 'command' \"" + *itr +
+        throw state.make_error(": channel 'command' \"" + itr->to_string() +
                                "\" is not recognized."          );
     }
 }
@@ -442,13 +513,14 @@ Channel get_channel_by_progressing_iterator
         } else if (**beg == "two") {
             channel = Channel::PULSE_TWO;
         } else {
-            throw state.make_error(": \"" + **beg + "\" is not a valid pulse "
-                                   "channel."                                );
+            throw state.make_error(": \"" + (*beg)->to_string() +
+                                   "\" is not a valid pulse channel.");
         }
     } else if (**beg == "noise") {
         channel = Channel::NOISE;
     } else {
-        throw state.make_error(": \"" + **beg + "\" is not a valid channel.");
+        throw state.make_error(": \"" + (*beg)->to_string() +
+                               "\" is not a valid channel.");
     }
     ++(*beg);
     return channel;
@@ -121,14 +121,15 @@ AssumptionRAII TextProcessState::get_scoped_assumption_restorer() {
 }
 
 void TextProcessState::add_instruction
-    (erfin::Inst inst, const std::string * label)
+    (erfin::Inst inst, const Token * label)
 {
     m_inst_to_source_line.push_back(m_current_source_line);
     if (label) {
         // if you have a label, there must be space to insert the immd
         // this is marked by leaving the 16 lsb equal to 0.
         assert((serialize(inst) & 0xFFFF) == 0);
-        m_unfulfilled_labels.emplace_back(m_program_data.size(), *label);
+        m_unfulfilled_labels.emplace_back
+            (m_program_data.size(), label->to_string());
     }
     m_program_data.push_back(inst);
 }
@@ -185,9 +186,10 @@ StringCIter TextProcessState::process_label(StringCIter beg, StringCIter end) {
     if (string_to_register(*beg) != erfin::Reg::COUNT) {
         throw make_error(": register cannot be used as a label.");
     }
-    auto itr = m_labels.find(*beg);
+    auto label = beg->to_string();
+    auto itr = m_labels.find(label);
     if (itr == m_labels.end()) {
-        m_labels[*beg] = LabelPair { m_program_data.size(), m_current_source_line };
+        m_labels[label] = LabelPair { m_program_data.size(), m_current_source_line };
     } else {
         throw make_error(": dupelicate label, previously defined on line: " +
                          std::to_string(itr->second.source_line));
@@ -265,7 +267,7 @@ void process_text(TextProcessState & state, StringCIter beg, StringCIter end) {
             beg = state.process_label(beg, end);
         } else {
             throw state.make_error(
-                             " first token \"" + *beg +
+                             " first token \"" + beg->to_string() +
                              "\" is neither directive, label, or instruction.");
         }
     }
@@ -300,8 +302,8 @@ StringCIter process_data
         } else if (*beg == "numbers") {
             process_func = process_numbers;
         } else {
-            throw state.make_error(": encoding scheme \"" + *beg + "\" not "
-                                   "recognized.");
+            throw state.make_error(": encoding scheme \"" + beg->to_string() +
+                                   "\" not recognized.");
         }
         ++beg;
     }
@@ -334,7 +336,8 @@ StringCIter process_binary
     int bit_pos = 0;
     assert(data.empty());
     while (*beg != "]") {
-        for (char c : *beg) {
+        for (std::size_t i = 0; i != beg->size(); ++i) {
+            char c = (*beg)[i];
             switch (c) {
             case '_': case 'o': case '0': case '.': case '1': case 'x':
                 if (bit_pos == 0)
@@ -426,7 +429,7 @@ namespace erfin {
     TextProcessState state;
     // data encodings
     {
-    const std::vector<std::string> sample_binary = {
+    const TokensContainer sample_binary = {
         "____xxxx", "____x_xxx___x__x", "xx__x_x_", "\n",
         "]"
     };
@@ -435,7 +438,7 @@ namespace erfin {
     assert(serialize(state.m_program_data.back()) == 252414410);
     }
     {
-    const std::vector<std::string> sample_data = {
+    const TokensContainer sample_data = {
         "data", "binary", "[", "\n",
             "____xxxxxx__x_x_", "\n", // 4042
             "___x_xxx____x__x", "\n", // 5897
@@ -445,7 +448,7 @@ namespace erfin {
     assert(serialize(state.m_program_data.back()) == 264902409);
     }
     {
-    const std::vector<std::string> sample_label = {
+    const TokensContainer sample_label = {
         ":", "hello", "and", "x", "y", "\n"
                     , "jump", "hello"
     };
@@ -69,7 +69,7 @@ public:
     // having some encapsulation, helps me to change the state in predictable
     // ways rather than having to micro-manage everything >.>
 
-    void add_instruction(erfin::Inst inst, const std::string * label = nullptr);
+    void add_instruction(erfin::Inst inst, const Token * label = nullptr);
 
     // regular text processing does not need this
     void move_program
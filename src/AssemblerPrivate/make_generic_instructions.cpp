@@ -106,7 +106,7 @@ StringCIter make_generic_arithemetic
     Reg a1, a2;
     Inst inst;
     Immd (*handle_immd)(StringCIter, OpCode, TextProcessState &) = nullptr;
-    const std::string * label = nullptr;
+    const Token * label = nullptr;
     auto do_nothing_for_label =
         [](StringCIter, OpCode, TextProcessState &) { return Immd(); };
     static constexpr const int IS_FP = 0, IS_INT = 1, INDETERMINATE = -1;
@@ -173,7 +173,7 @@ StringCIter make_generic_memory_access
     const auto eol = get_eol(++beg, end);
     assert(!get_line_processing_function(Assembler::NO_ASSUMPTIONS, *beg));
 
-    const std::string * label = nullptr;
+    const Token * label = nullptr;
     Inst inst;
 
     NumericParseInfo npi;
@@ -243,7 +243,8 @@ erfin::Immd deal_with_int_immd
     if (!op_code_supports_integer_immd(op_code))
         throw state.make_error(int_unsupported_msg);
     int i;
-    string_to_number(&(eol - 1)->front(), &(eol - 1)->back() + 1, i);
+    const auto & immd = *(eol - 1);
+    string_to_number(immd.data(), immd.data() + immd.size(), i);
     return erfin::encode_immd_int(i);
 }
 
@@ -255,7 +256,8 @@ erfin::Immd deal_with_fp_immd
     if (!op_code_supports_fpoint_immd(op_code))
         throw state.make_error(fp_unsupported_msg);
     double d;
-    string_to_number(&(eol - 1)->front(), &(eol - 1)->back() + 1, d);
+    const auto & immd = *(eol - 1);
+    string_to_number(immd.data(), immd.data() + immd.size(), d);
     return erfin::encode_immd_fp(d);
 }
 
@@ -0,0 +1,467 @@
+/****************************************************************************
+
+    File: BatchRunner.cpp
+    Author: Andrew Janke
+    License: GPLv3
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*****************************************************************************/
+
+#include "BatchRunner.hpp"
+
+#include "Assembler.hpp"
+#include "ErfiConsole.hpp"
+#include "FixedPointUtil.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <thread>
+
+#include <cassert>
+
+namespace {
+
+const char * outcome_to_string(erfin::BatchRunner::Outcome);
+
+using FrameHashes = std::vector<erfin::UInt64>;
+
+// golden frame hashes by program name
+std::map<std::string, FrameHashes> read_golden_frames(std::istream &);
+
+} // end of <anonymous> namespace
+
+namespace erfin {
+
+struct BatchRunner::Job {
+    std::string name;
+    Assembler assembler;
+    std::string error; // assembly (or file) error, the job is not run
+};
+
+constexpr /* static */ const std::size_t BatchRunner::DEFAULT_FRAME_LIMIT;
+constexpr /* static */ const std::size_t BatchRunner::DEFAULT_INSTRUCTION_LIMIT;
+constexpr /* static */ const unsigned BatchRunner::DEFAULT_FRAME_RATE;
+constexpr /* static */ const UInt32 BatchRunner::DEFAULT_RNG_SEED;
+
+BatchRunner::BatchRunner():
+    m_thread_count(0),
+    m_frame_limit(DEFAULT_FRAME_LIMIT),
+    m_instruction_limit(DEFAULT_INSTRUCTION_LIMIT),
+    m_dispatcher(ErfiCpu::DEFAULT_DISPATCHER),
+    m_time_step(to_fixed_point(1.0 / double(DEFAULT_FRAME_RATE))),
+    m_rng_seed(DEFAULT_RNG_SEED),
+    m_hash_frames(false)
+{}
+
+BatchRunner::~BatchRunner() {}
+
+void BatchRunner::set_frame_rate(unsigned fps) {
+    assert(fps != 0);
+    m_time_step = to_fixed_point(1.0 / double(fps));
+}
+
+void BatchRunner::add_program_from_file(const std::string & filename) {
+    std::ifstream fin(filename.c_str(), std::ifstream::binary);
+    if (!fin) {
+        m_jobs.emplace_back(new Job());
+        m_jobs.back()->name  = filename;
+        m_jobs.back()->error = "Failed to open file.";
+        return;
+    }
+    std::stringstream sstrm;
+    sstrm << fin.rdbuf();
+    add_program(filename, sstrm.str());
+}
+
+void BatchRunner::add_program_from_string
+    (const std::string & name, const std::string & source)
+    { add_program(name, std::string(source)); }
+
+std::vector<BatchRunner::Result> BatchRunner::run() const {
+    std::vector<Result> results(m_jobs.size());
+    std::atomic<std::size_t> next_job(0);
+    // jobs are handed out one at a time, as run times vary wildly
+    auto work = [this, &results, &next_job]() {
+        for (auto i = next_job++; i < m_jobs.size(); i = next_job++)
+            results[i] = run_job(*m_jobs[i]);
+    };
+
+    std::size_t thread_count = m_thread_count;
+    if (thread_count == 0)
+        thread_count = std::max(1u, std::thread::hardware_concurrency());
+    thread_count = std::min(thread_count, m_jobs.size());
+
+    // the calling thread is one of the workers
+    std::vector<std::thread> workers;
+    for (std::size_t i = 1; i < thread_count; ++i)
+        workers.emplace_back(work);
+    work();
+    for (auto & worker : workers)
+        worker.join();
+    return results;
+}
+
+/* static */ void BatchRunner::print_results
+    (std::ostream & out, const std::vector<Result> & results)
+{
+    std::size_t failures = 0;
+    for (const auto & res : results) {
+        out << res.name << ": " << outcome_to_string(res.outcome)
+            << ", frames " << res.frames
+            << ", instructions " << res.instructions << "\n";
+        if (res.outcome == Outcome::FAILED) {
+            out << "    " << res.error << "\n";
+            ++failures;
+        }
+    }
+    out << results.size() << " program(s) run, " << failures << " failed."
+        << std::endl;
+}
+
+/* static */ UInt64 BatchRunner::hash_screen(const ErfiGpu::VideoMemory & screen) {
+    // a byte at a time, most significant first, so hashes do not depend on
+    // the host
+    UInt64 hash = 0xCBF29CE484222325ull;
+    for (auto word : screen) {
+        for (int shift = 56; shift != -8; shift -= 8) {
+            hash ^= (word >> shift) & 0xFF;
+            hash *= 0x100000001B3ull;
+        }
+    }
+    return hash;
+}
+
+/* static */ void BatchRunner::write_golden_frames
+    (std::ostream & out, const std::vector<Result> & results)
+{
+    out << "# program, frame, screen hash (see BatchRunner::hash_screen)\n"
+        << std::hex << std::setfill('0');
+    for (const auto & res : results) {
+        for (std::size_t i = 0; i != res.frame_hashes.size(); ++i) {
+            out << res.name << " " << std::dec << i << " " << std::hex
+                << std::setw(16) << res.frame_hashes[i] << "\n";
+        }
+    }
+    out << std::dec << std::setfill(' ');
+}
+
+/* static */ std::size_t BatchRunner::compare_golden_frames
+    (std::istream & golden_stream, const std::vector<Result> & results,
+     std::ostream & report)
+{
+    auto golden = read_golden_frames(golden_stream);
+    std::size_t differences = 0;
+    for (const auto & res : results) {
+        auto itr = golden.find(res.name);
+        if (itr == golden.end()) {
+            report << res.name << ": has no golden frames\n";
+            ++differences;
+            continue;
+        }
+        const auto & expected = itr->second;
+        const auto & actual   = res.frame_hashes;
+        auto common = std::min(expected.size(), actual.size());
+        auto diverges = std::mismatch
+            (actual.begin(), actual.begin() + std::ptrdiff_t(common),
+             expected.begin()).first - actual.begin();
+        if (std::size_t(diverges) != common) {
+            report << res.name << ": first differs on frame " << diverges
+                   << "\n";
+            ++differences;
+        } else if (expected.size() != actual.size()) {
+            report << res.name << ": ran for " << actual.size()
+                   << " frame(s), the golden frames have " << expected.size()
+                   << "\n";
+            ++differences;
+        }
+        golden.erase(itr);
+    }
+    for (const auto & pair : golden) {
+        report << pair.first << ": has golden frames, but was not run\n";
+        ++differences;
+    }
+    return differences;
+}
+
+/* static */ void BatchRunner::run_tests() {
+    BatchRunner runner;
+    runner.set_thread_count(2);
+    runner.set_frame_limit(10);
+    runner.add_program_from_string("halts",
+        "assume integer\n"
+        "     set  x 0\n"
+        "     set  b 1\n"
+        ":top add  x 1\n"
+        "     io   wait b\n"
+        "     comp a x 3\n"
+        "     skip a >=\n"
+        "     jump top\n"
+        "     io   halt a\n");
+    runner.add_program_from_string("waits-forever",
+        "     set a 1\n"
+        ":top io  wait a\n"
+        "     jump top\n");
+    runner.add_program_from_string("faults",
+        "assume integer\n"
+        "set a 1\n"
+        "set b 0\n"
+        "div a a b\n");
+    runner.add_program_from_string("bad-source", "not-an-instruction a b\n");
+    runner.add_program_from_file("<no such file>.efas");
+
+    auto results = runner.run();
+    assert(results.size() == 5);
+    assert(results[0].outcome == Outcome::HALTED);
+    assert(results[0].frames == 4);
+    assert(results[1].outcome == Outcome::FRAME_LIMIT);
+    assert(results[1].frames == 10);
+    assert(results[2].outcome == Outcome::FAILED);
+    assert(results[2].instructions == 2 && results[2].frames == 1);
+    assert(results[2].error.find("line 4") != std::string::npos);
+    assert(results[3].outcome == Outcome::FAILED);
+    assert(results[4].outcome == Outcome::FAILED);
+
+    // results do not depend on the number of threads
+    runner.set_thread_count(1);
+    auto serial_results = runner.run();
+    for (std::size_t i = 0; i != results.size(); ++i) {
+        assert(serial_results[i].instructions == results[i].instructions);
+        assert(serial_results[i].frames       == results[i].frames      );
+    }
+
+    // a program which never waits is stopped by the instruction limit
+    {
+    BatchRunner limited;
+    limited.set_instruction_limit(1000);
+    limited.add_program_from_string("spins", ":top jump top\n");
+    auto res = limited.run();
+    assert(res.front().outcome == Outcome::INSTRUCTION_LIMIT);
+    assert(res.front().instructions == 1000);
+    (void)res;
+    }
+    // timer and random numbers only depend on the frame rate and seed
+    {
+    static constexpr const char * const TIMED_SOURCE =
+        "assume fixed-point\n"
+        "     set  c 0\n"
+        "     set  b 1\n"
+        ":top io   wait b\n"
+        "     io   read timer a\n"
+        "     add  c c a\n"
+        "     comp a c 0.5\n"
+        "     skip a >=\n"
+        "     jump top\n"
+        "     io   halt a\n";
+    static constexpr const char * const RANDOM_SOURCE =
+        "assume integer\n"
+        "     set  b 1\n"
+        ":top io   wait b\n"
+        "     io   read random a\n"
+        "     and  a 7\n"
+        "     skip a\n"
+        "     io   halt a\n"
+        "     jump top\n";
+    // the last run uses a lower frame rate
+    const unsigned frame_rates[] = { 60, 60, 10 };
+    std::vector<Result> runs[3];
+    for (int i = 0; i != 3; ++i) {
+        BatchRunner timed;
+        timed.set_rng_seed(1234);
+        timed.set_frame_rate(frame_rates[i]);
+        timed.add_program_from_string("timed" , TIMED_SOURCE );
+        timed.add_program_from_string("random", RANDOM_SOURCE);
+        runs[i] = timed.run();
+        assert(runs[i][0].outcome == Outcome::HALTED);
+        assert(runs[i][1].outcome == Outcome::HALTED);
+    }
+    for (std::size_t i = 0; i != runs[0].size(); ++i) {
+        assert(runs[0][i].frames       == runs[1][i].frames      );
+        assert(runs[0][i].instructions == runs[1][i].instructions);
+    }
+    // readings add up to half a second (a 1/60 step rounds down, so it
+    // takes 31), plus the frame before the first reading
+    assert(runs[0][0].frames == 32);
+    assert(runs[2][0].frames == 6 );
+    (void)frame_rates;
+    }
+    // frame hashes only depend on the program, and golden frames find
+    // where they first differ
+    {
+    static constexpr const char * const MOVING_SOURCE =
+        "assume integer\n"
+        "     set  sp stack\n"
+        "     set  x 8\n"
+        "     set  y 8\n"
+        "     set  a sprite\n"
+        "     set  z 4096\n"
+        "     io   upload x y a z\n"
+        "     set  x 0\n"
+        ":top io   clear a\n"
+        "     add  x 1\n"
+        "     io   draw x x z\n"
+        "     io   wait a\n"
+        "     jump top\n"
+        ":sprite data [ XXXXXXXX X______X X______X XXXXXXXX\n"
+        "               XXXXXXXX X______X X______X XXXXXXXX ]\n"
+        ":stack  data [ ________ ________ ________ ________ ]\n";
+    BatchRunner hashed;
+    hashed.set_frame_limit(8);
+    hashed.set_frame_hashing(true);
+    hashed.add_program_from_string("moving", MOVING_SOURCE);
+    hashed.add_program_from_string("moving-again", MOVING_SOURCE);
+    auto hashed_results = hashed.run();
+    const auto & hashes = hashed_results[0].frame_hashes;
+    assert(hashes.size() == 8);
+    assert(hashes == hashed_results[1].frame_hashes);
+    // the screen is one frame behind, and then the sprite moves each frame
+    assert(hashes[0] == hash_screen(ErfiGpu::VideoMemory
+           (std::size_t(ErfiGpu::WORDS_PER_ROW*ErfiGpu::SCREEN_HEIGHT), 0)));
+    assert(hashes[1] != hashes[2] && hashes[2] != hashes[3]);
+
+    std::stringstream golden;
+    write_golden_frames(golden, hashed_results);
+    std::stringstream report;
+    assert(compare_golden_frames(golden, hashed_results, report) == 0);
+    assert(report.str().empty());
+
+    auto changed = hashed_results;
+    changed[1].frame_hashes[5] ^= 1;
+    changed[0].frame_hashes.pop_back();
+    golden.clear();
+    golden.seekg(0);
+    assert(compare_golden_frames(golden, changed, report) == 2);
+    assert(report.str().find("moving-again: first differs on frame 5") !=
+           std::string::npos);
+    assert(report.str().find("moving: ran for 7") != std::string::npos);
+    }
+    (void)results; (void)serial_results;
+}
+
+/* private */ void BatchRunner::add_program
+    (const std::string & name, std::string && source)
+{
+    std::unique_ptr<Job> job(new Job());
+    job->name = name;
+    try {
+        job->assembler.assemble_from_string(source);
+    } catch (std::exception & exp) {
+        job->error = exp.what();
+    }
+    m_jobs.emplace_back(std::move(job));
+}
+
+/* private */ BatchRunner::Result BatchRunner::run_job(const Job & job) const {
+    Result rv;
+    rv.name         = job.name;
+    rv.outcome      = Outcome::FAILED;
+    rv.instructions = 0;
+    rv.frames       = 0;
+    if (!job.error.empty()) {
+        rv.error = job.error;
+        return rv;
+    }
+
+    // consoles are far too large for a worker's stack
+    std::unique_ptr<Console> console(new Console());
+    console->set_cpu_dispatcher(m_dispatcher);
+    console->set_virtual_time_step(m_time_step);
+    console->seed_rng(m_rng_seed);
+    console->load_program(job.assembler.program_data());
+    try {
+        while (!console->trying_to_shutdown()) {
+            if (rv.frames == m_frame_limit) {
+                rv.outcome = Outcome::FRAME_LIMIT;
+                return rv;
+            }
+            if (rv.instructions == m_instruction_limit) {
+                rv.outcome = Outcome::INSTRUCTION_LIMIT;
+                return rv;
+            }
+            console->run_until_wait(m_instruction_limit - rv.instructions);
+            rv.instructions = console->instruction_count();
+            ++rv.frames;
+            if (m_hash_frames)
+                rv.frame_hashes.push_back(hash_screen(console->current_screen()));
+        }
+        rv.outcome = Outcome::HALTED;
+    } catch (ErfiCpuError & exp) {
+        std::stringstream sstrm;
+        auto line_num = job.assembler.translate_to_line_number
+            (exp.program_location());
+        sstrm << "On ";
+        if (line_num == Assembler::INVALID_LINE_NUMBER)
+            sstrm << "no source line";
+        else
+            sstrm << "line " << line_num;
+        sstrm << " (at address " << exp.program_location() << "): "
+              << exp.what();
+        rv.error = sstrm.str();
+    } catch (std::exception & exp) {
+        rv.error = exp.what();
+    }
+    // the frame which failed is counted
+    if (rv.outcome == Outcome::FAILED) {
+        rv.instructions = console->instruction_count();
+        ++rv.frames;
+    }
+    return rv;
+}
+
+} // end of erfin namespace
+
+namespace {
+
+std::map<std::string, FrameHashes> read_golden_frames(std::istream & in) {
+    std::map<std::string, FrameHashes> rv;
+    std::string line;
+    std::size_t line_number = 0;
+    while (std::getline(in, line)) {
+        ++line_number;
+        if (line.empty() || line[0] == '#') continue;
+        std::stringstream sstrm(line);
+        std::string name;
+        std::size_t frame = 0;
+        erfin::UInt64 hash = 0;
+        if (!(sstrm >> name >> std::dec >> frame >> std::hex >> hash)) {
+            throw std::runtime_error("Golden frames are malformed on line " +
+                                     std::to_string(line_number) + ".");
+        }
+        auto & hashes = rv[name];
+        if (frame != hashes.size()) {
+            throw std::runtime_error("Golden frames are out of order on line " +
+                                     std::to_string(line_number) + ".");
+        }
+        hashes.push_back(hash);
+    }
+    return rv;
+}
+
+const char * outcome_to_string(erfin::BatchRunner::Outcome outcome) {
+    using Outcome = erfin::BatchRunner::Outcome;
+    switch (outcome) {
+    case Outcome::HALTED           : return "halted";
+    case Outcome::FRAME_LIMIT      : return "frame limit reached";
+    case Outcome::INSTRUCTION_LIMIT: return "instruction limit reached";
+    case Outcome::FAILED           : return "failed";
+    }
+    return "<invalid outcome>";
+}
+
+} // end of <anonymous> namespace
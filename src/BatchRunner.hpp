@@ -0,0 +1,152 @@
+/****************************************************************************
+
+    File: BatchRunner.hpp
+    Author: Andrew Janke
+    License: GPLv3
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*****************************************************************************/
+
+#ifndef MACRO_HEADER_GUARD_ERFINDUNG_BATCH_RUNNER_HPP
+#define MACRO_HEADER_GUARD_ERFINDUNG_BATCH_RUNNER_HPP
+
+#include "ErfiDefs.hpp"
+#include "ErfiCpu.hpp"
+#include "ErfiGpu.hpp"
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <iosfwd>
+
+namespace erfin {
+
+class Assembler;
+
+/** @brief Runs many programs headlessly, each in its own Console, on a pool
+ *  of worker threads.
+ *
+ *  Every console runs on virtual time with the same seed, so the results
+ *  depend only on the programs and never on how busy the host is.
+ *  Programs are assembled on the calling thread as they are added (the
+ *  assembler is not thread safe), only the consoles run in parallel.
+ */
+class BatchRunner {
+public:
+    enum class Outcome {
+        HALTED,            // sent the halt signal
+        FRAME_LIMIT,       // still running when the frame limit was reached
+        INSTRUCTION_LIMIT, // still running when the instruction limit was
+                           // reached (e.g. a loop which never waits)
+        FAILED             // failed to assemble, or faulted while running
+    };
+
+    struct Result {
+        std::string name;
+        Outcome outcome;
+        std::size_t instructions;
+        std::size_t frames;
+        std::string error; // empty unless outcome is FAILED
+        // hash of the screen after each frame which finished, empty unless
+        // frame hashing is on
+        std::vector<UInt64> frame_hashes;
+    };
+
+    static constexpr const std::size_t DEFAULT_FRAME_LIMIT = 3600;
+    static constexpr const std::size_t DEFAULT_INSTRUCTION_LIMIT = 1000000000;
+    // of virtual time
+    static constexpr const unsigned DEFAULT_FRAME_RATE = 60;
+    static constexpr const UInt32 DEFAULT_RNG_SEED = 0;
+
+    BatchRunner();
+    BatchRunner(const BatchRunner &) = delete;
+    ~BatchRunner();
+
+    BatchRunner & operator = (const BatchRunner &) = delete;
+
+    /** @param count number of worker threads, zero uses as many as the
+     *               hardware supports
+     */
+    void set_thread_count(unsigned count) { m_thread_count = count; }
+
+    void set_frame_limit(std::size_t frames) { m_frame_limit = frames; }
+
+    void set_instruction_limit(std::size_t limit)
+        { m_instruction_limit = limit; }
+
+    void set_dispatcher(ErfiCpu::Dispatcher dispatcher)
+        { m_dispatcher = dispatcher; }
+
+    /** @param fps frames per second of virtual time, must not be zero */
+    void set_frame_rate(unsigned fps);
+
+    void set_rng_seed(UInt32 seed) { m_rng_seed = seed; }
+
+    /** Hashes the screen after every frame (see Result::frame_hashes). */
+    void set_frame_hashing(bool on) { m_hash_frames = on; }
+
+    void add_program_from_file(const std::string & filename);
+
+    void add_program_from_string
+        (const std::string & name, const std::string & source);
+
+    /** Runs every program added so far.
+     *  @return one result per program, in the order they were added
+     */
+    std::vector<Result> run() const;
+
+    static void print_results(std::ostream &, const std::vector<Result> &);
+
+    /** @return 64-bit FNV-1a hash of the screen's pixels */
+    static UInt64 hash_screen(const ErfiGpu::VideoMemory &);
+
+    /** Writes every result's frame hashes, one "<name> <frame> <hash>" line
+     *  per frame (hashes in hex).
+     */
+    static void write_golden_frames(std::ostream &, const std::vector<Result> &);
+
+    /** Compares results against golden frames written by
+     *  write_golden_frames, printing the first frame where each program
+     *  differs, if any.
+     *  @return number of programs which differ, a program missing from
+     *          either side or running for a different number of frames
+     *          differs too
+     *  @throws if the golden frames are malformed
+     */
+    static std::size_t compare_golden_frames
+        (std::istream & golden, const std::vector<Result> &, std::ostream & report);
+
+    static void run_tests();
+
+private:
+    struct Job;
+
+    void add_program(const std::string & name, std::string && source);
+
+    Result run_job(const Job &) const;
+
+    unsigned m_thread_count;
+    std::size_t m_frame_limit;
+    std::size_t m_instruction_limit;
+    ErfiCpu::Dispatcher m_dispatcher;
+    UInt32 m_time_step;
+    UInt32 m_rng_seed;
+    bool m_hash_frames;
+    std::vector<std::unique_ptr<Job>> m_jobs;
+};
+
+} // end of erfin namespace
+
+#endif
@@ -25,6 +25,7 @@
 #include "ErfiDefs.hpp"
 
 #include <set>
+#include <string>
 
 namespace erfin {
 
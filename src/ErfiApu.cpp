@@ -25,9 +25,11 @@
 #   include <SFML/Audio/SoundStream.hpp>
 #endif
 
+#include <algorithm>
+#include <atomic>
 #include <bitset>
 #include <iostream>
-#include <mutex>
+#include <memory>
 
 #include <cmath>
 #include <cassert>
@@ -43,7 +45,6 @@ constexpr const std::size_t DUTY_CYCLE_WINDOW_SIZE = sizeof(int32_t)*8;
 using DutyCycleWindow = std::bitset<DUTY_CYCLE_WINDOW_SIZE>;
 
 using ChannelSamples  = std::vector<std::vector<std::int16_t>>;
-using Rng = std::default_random_engine;
 
 template <typename T>
 T mag(T t) { return t < T(0) ? T(-t) : t; }
@@ -63,8 +64,79 @@ void set_bitset(IntType, std::bitset<sizeof(IntType)*8> &);
 template <typename Container>
 void remove_first(Container & c, std::size_t num);
 
+// Passes samples from the APU to the audio device's thread, without locks.
+// Only whole sample frames (one sample for each channel) are ever written,
+// so the channels never shift.
+// An update may make seconds of notes at once, far more than the ring holds,
+// what does not fit waits on the APU's side and is topped up on later updates.
+class PcmHandOff {
+public:
+    static constexpr const std::size_t CAPACITY = 1 << 15;
+    static constexpr const std::size_t FRAME_SIZE = std::size_t(erfin::Channel::COUNT);
+    // samples waiting beyond the ring, a minute of audio
+    static constexpr const std::size_t MAX_BACKLOG =
+        std::size_t(erfin::Apu::SAMPLE_RATE)*60*FRAME_SIZE;
+
+    PcmHandOff(): m_backlog_start(0), m_overruns(0), m_underruns(0) {}
+
+    // ------------------------- APU thread (producer) ------------------------
+
+    // samples which do not fit wait in the backlog, only the oldest samples
+    // beyond MAX_BACKLOG are dropped (and counted as overruns)
+    void write(const Int16 * samples, std::size_t count);
+
+    // moves as much of the backlog into the ring as there is room for
+    void top_up();
+
+    std::size_t backlog() const { return m_backlog.size() - m_backlog_start; }
+
+    // ----------------------- device thread (consumer) -----------------------
+
+    std::size_t available() const { return m_ring.size(); }
+
+    // @return number of samples read, reading none counts as an underrun
+    std::size_t read(Int16 * samples, std::size_t max_count);
+
+    // ------------------------------------------------------------------------
+
+    std::size_t overruns () const { return m_overruns .load(); }
+    std::size_t underruns() const { return m_underruns.load(); }
+
+private:
+    static_assert(CAPACITY % FRAME_SIZE == 0, "Ring must hold whole frames.");
+
+    erfin::SpscRing<Int16, CAPACITY> m_ring;
+    // only ever touched by the producer, samples before the start have been
+    // written already (they are erased once they are half of it)
+    std::vector<Int16> m_backlog;
+    std::size_t m_backlog_start;
+    std::atomic<std::size_t> m_overruns;
+    std::atomic<std::size_t> m_underruns;
+};
+
+// Writes a whole note of samples_count samples, one period of the wave at a
+// time. The sample function is given the wave position and the sample's
+// index in the note.
+template <typename SampleFunc>
+void synthesize_note(Int16 * samples, SampleFunc sample_function, int pitch,
+                     int samples_count, const DutyCycleWindow & duty_cycles);
+
+// adapts a function of the wave position alone for synthesize_note
+template <typename BaseWaveFunc>
+struct WaveFunction {
+    BaseWaveFunc base_function;
+    Int16 operator () (Int16 wave_position, int) const
+        { return base_function(wave_position); }
+};
+
+template <typename BaseWaveFunc>
+WaveFunction<BaseWaveFunc> wave_function(BaseWaveFunc f)
+    { return WaveFunction<BaseWaveFunc> { f }; }
+
+// Old sample at a time version of synthesize_note (appending to samples),
+// kept to test against.
 template <typename BaseWaveFunc>
-void generate_note_full(std::vector<Int16> & samples,
+void generate_note_full_by_loop(std::vector<Int16> & samples,
                    BaseWaveFunc base_function, int pitch, int tempo,
                    const DutyCycleWindow duty_cycles);
 
@@ -72,17 +144,38 @@ void generate_note_full(std::vector<Int16> & samples,
 
 namespace erfin {
 
+// samples handed to the device's thread at a time
+constexpr const std::size_t AUDIO_CHUNK_SIZE = 1024*PcmHandOff::FRAME_SIZE;
+
 #ifdef MACRO_BUILD_STL_ONLY
+// Null sink, nothing is played, but every sample still goes through the hand
+// off (so it can be timed headless).
 class SfmlAudioDevice {
 public:
-    void upload_samples(const std::vector<Int16> &) {}
+    SfmlAudioDevice(): m_chunk(AUDIO_CHUNK_SIZE) {}
+
+    void upload_samples(const Int16 * samples, std::size_t count) {
+        m_pcm.write(samples, count);
+        while (m_pcm.available() != 0) {
+            m_pcm.read(m_chunk.data(), m_chunk.size());
+            m_pcm.top_up();
+        }
+    }
+
+    const PcmHandOff & pcm() const { return m_pcm; }
+
+private:
+    PcmHandOff m_pcm;
+    std::vector<Int16> m_chunk;
 };
 #else
 class SfmlAudioDevice final : private sf::SoundStream {
 public:
     SfmlAudioDevice();
 
-    void upload_samples(const std::vector<Int16> &);
+    void upload_samples(const Int16 * samples, std::size_t count);
+
+    const PcmHandOff & pcm() const { return m_pcm; }
 
     ~SfmlAudioDevice() { stop(); }
 
@@ -91,27 +184,37 @@ private:
 
     void onSeek(sf::Time) override {}
 
-    std::vector<Int16> m_samples;
-    std::vector<Int16> m_samples_hot;
-    std::mutex m_samples_mutex;
+    PcmHandOff m_pcm;
+    std::vector<Int16> m_chunk; // SFML plays from this until the next chunk
 };
 #endif
+
+constexpr /* static */ const std::size_t Apu::COMMAND_CAPACITY;
+constexpr /* static */ const int Apu::SAMPLE_RATE;
+constexpr /* static */ const std::size_t Apu::PREALLOCATED_SAMPLES;
+
 Apu::Apu():
     m_channel_info       (static_cast<std::size_t>(Channel::COUNT)),
     m_samples_per_channel(static_cast<std::size_t>(Channel::COUNT)),
     m_audio_device       (new SfmlAudioDevice()),
-    m_rng                (std::random_device()())
+    m_device_enabled     (true),
+    m_noise              ()
 {
     static_assert(std::is_same<DutyCycleWindow, ::DutyCycleWindow>::value,
                   "Implementation detail DutyCycleWindow definition needs to "
                   "be updated.");
+    for (auto & samples : m_samples_per_channel)
+        samples.reserve(PREALLOCATED_SAMPLES);
+    m_samples.reserve(PREALLOCATED_SAMPLES*m_samples_per_channel.size());
 }
 
 Apu::~Apu() { delete m_audio_device; }
 
 void Apu::enqueue(Channel c, ApuInstructionType t, int val) {
-    for (auto i : { UInt32(c), UInt32(t), UInt32(val) })
-        m_insts.push(i);
+    for (auto i : { UInt32(c), UInt32(t), UInt32(val) }) {
+        if (!m_insts.push(i))
+            throw Error("APU command stream is full.");
+    }
 }
 
 void Apu::enqueue(ApuInst i) { enqueue(i.channel, i.type, i.value); }
@@ -119,11 +222,18 @@ void Apu::enqueue(ApuInst i) { enqueue(i.channel, i.type, i.value); }
 void Apu::update() {
     process_instructions();
     merge_samples(m_samples_per_channel, m_samples, ALL_POSSIBLE_SAMPLE_FRAMES);
-    m_audio_device->upload_samples(m_samples);
-    m_samples.clear();
+    if (m_device_enabled)
+        m_audio_device->upload_samples(m_samples.data(), m_samples.size());
 }
 
-void Apu::io_write(UInt32 data) { m_insts.push(data); }
+bool Apu::io_write(UInt32 data) { return m_insts.push(data); }
+
+Apu::AudioDeviceStats Apu::audio_device_stats() const {
+    AudioDeviceStats rv;
+    rv.overruns  = m_audio_device->pcm().overruns ();
+    rv.underruns = m_audio_device->pcm().underruns();
+    return rv;
+}
 
 /* private */ void Apu::process_instructions() {
     static constexpr const char * const INVALID_INST_ERROR_MSG =
@@ -134,13 +244,18 @@ void Apu::io_write(UInt32 data) { m_insts.push(data); }
         "APU was provided an invalid channel value, this could be a "
         "result of pushing values out of order to the APU.";
 
-    auto front_and_pop = [this]() -> UInt32
-        { auto i = m_insts.front(); m_insts.pop(); return i; };
+    static constexpr const char * const NOISE_CHNL_ERROR_MSG =
+        "APU noise mode may only be set for the noise channel.";
 
-    while (!m_insts.empty() && m_insts.size() >= 3) {
-        auto channel   = static_cast<Channel>(front_and_pop());
-        auto inst_type = static_cast<ApuInstructionType>(front_and_pop());
-        auto value     = int(front_and_pop());
+    static constexpr const char * const INVALID_MODE_ERROR_MSG =
+        "APU was provided an invalid noise mode (it must be zero for the "
+        "long period, or one for the short).";
+
+    while (m_insts.size() >= 3) {
+        auto channel   = static_cast<Channel>(m_insts.peek(0));
+        auto inst_type = static_cast<ApuInstructionType>(m_insts.peek(1));
+        auto value     = int(m_insts.peek(2));
+        m_insts.pop(3);
 
         if (!is_valid_value(inst_type)) throw Error(INVALID_INST_ERROR_MSG);
         if (!is_valid_value(channel  )) throw Error(INVALID_CHNL_ERROR_MSG);
@@ -155,6 +270,12 @@ void Apu::io_write(UInt32 data) { m_insts.push(data); }
         case ApuInstructionType::DUTY_CYCLE_WINDOW:
             set_bitset(value, *select_duty_cycle_window(channel));
             break;
+        case ApuInstructionType::NOISE_MODE:
+            if (channel != Channel::NOISE) throw Error(NOISE_CHNL_ERROR_MSG);
+            if (!is_valid_value(static_cast<NoiseMode>(value)))
+                throw Error(INVALID_MODE_ERROR_MSG);
+            m_noise.set_mode(static_cast<NoiseMode>(value));
+            break;
         default: std::terminate(); // must change is_valid_value for inst_type!
         }
     }
@@ -181,26 +302,55 @@ void Apu::io_write(UInt32 data) { m_insts.push(data); }
     static const auto pulse_wave = [] (Int16 x) -> Int16
         { return (x < 0) ? -(MAX / 4): MAX / 4; };
 
-    auto & rng = m_rng;
-    auto noise = [&rng] (Int16) -> Int16
-        { return std::uniform_int_distribution<Int16>(-MAX, MAX)(rng); };
 
     const auto & dc_window = *select_duty_cycle_window(channel);
     auto tempo = *select_channel_tempo(channel);
+    if (tempo <= 0) {
+        throw Error("Tempo was not set (or is negative) for this channel, "
+                    "cannot generate note!");
+    }
+
     auto & chan = select_channel(channel);
+    auto note_start = chan.size();
+
+    // noise carries on from where the shift register left off, anything
+    // else may have been played before
+    const bool cachable = channel != Channel::NOISE;
+    const NoteCache::Key key {
+        channel == Channel::PULSE_TWO ? Channel::PULSE_ONE : channel,
+        note, tempo, UInt32(dc_window.to_ulong()) };
+    if (cachable) {
+        if (const auto * cached = m_note_cache.find(key)) {
+            chan.insert(chan.end(), cached->begin(), cached->end());
+            return;
+        }
+    }
+
+    // the whole note is written in place, the buffer only grows if it
+    // outgrows its preallocated memory
+    chan.resize(note_start + std::size_t(tempo));
+    Int16 * samples = &chan[note_start];
 
     switch (channel) {
     case Channel::TRIANGLE:
-        generate_note_full(chan, triangle_wave_function, note, tempo, dc_window);
+        synthesize_note(samples, wave_function(triangle_wave_function), note,
+                        tempo, dc_window);
         break;
     case Channel::PULSE_ONE: case Channel::PULSE_TWO:
-        generate_note_full(chan, pulse_wave, note, tempo, dc_window);
+        synthesize_note(samples, wave_function(pulse_wave), note, tempo,
+                        dc_window);
         break;
     case Channel::NOISE:
-        generate_note_full(chan, noise, note, tempo, dc_window);
+        // the register is clocked once a sample, for the whole note, then
+        // the duty cycles cut it just as they would any other wave
+        m_noise.fill(samples, std::size_t(tempo), MAX / 4);
+        synthesize_note(samples, [samples](Int16, int i) { return samples[i]; },
+                        note, tempo, dc_window);
         break;
     default: break;
     }
+    if (cachable)
+        m_note_cache.insert(key, samples, std::size_t(tempo));
 }
 
 /* private static */ void Apu::merge_samples
@@ -209,25 +359,229 @@ void Apu::io_write(UInt32 data) { m_insts.push(data); }
 {
     // no harm possible, but should be clearer on which member variables
     // "belong" to which thread
-    output_samples.clear();
     (void)sample_count;
     std::size_t themax = 0;
     for (const auto & samples_cont : channel_samples)
         themax = std::max(samples_cont.size(), themax);
-    for (std::size_t i = 0; i != themax; ++i) {
-        for (const auto & samples_cont : channel_samples) {
-            auto val = (i >= samples_cont.size()) ? Int16(0) : samples_cont[i];
-            output_samples.push_back(val);
-        }
+
+    // channels which run out early are padded with silence, so the output is
+    // zeroed first, then each channel is written into its interleaved slots
+    const auto channel_count = channel_samples.size();
+    output_samples.assign(themax*channel_count, 0);
+    for (std::size_t c = 0; c != channel_count; ++c) {
+        const auto & samples_cont = channel_samples[c];
+        Int16 * out = output_samples.data() + c;
+        const Int16 * in = samples_cont.data();
+        for (std::size_t i = 0; i != samples_cont.size(); ++i)
+            out[i*channel_count] = in[i];
     }
     for (auto & samples_cont : channel_samples)
         samples_cont.clear();
 }
 
+/* static */ void Apu::run_tests() {
+    static constexpr const Int16 MAX = std::numeric_limits<Int16>::max();
+    static const auto triangle = [](Int16 t) -> Int16 {
+        if (mag(t) < MAX / 2) return Int16(2*(t - 1));
+        return Int16(t < 0 ? 2*(-t - MAX) : 2*(-t + MAX));
+    };
+    static const auto pulse = [] (Int16 x) -> Int16
+        { return (x < 0) ? -(MAX / 4): MAX / 4; };
+
+    // notes come out exactly as they did from the sample at a time loop,
+    // for every duty cycle option, and for notes which end mid period
+    DutyCycleWindow window;
+    set_bitset(int32_t(0x1B1B1B1B), window);
+    for (int pitch : { 0, 1, 97, 200, 1000, 4096, 40000, 70000, -5 }) {
+    for (int count : { 1, 7, 183, 1378, 11025 }) {
+        std::vector<Int16> expected;
+        generate_note_full_by_loop(expected, triangle, pitch, count, window);
+        std::vector<Int16> samples(std::size_t(count), 1);
+        synthesize_note(samples.data(), wave_function(triangle), pitch, count, window);
+        assert(samples == expected);
+
+        expected.clear();
+        generate_note_full_by_loop(expected, pulse, pitch, count, window);
+        synthesize_note(samples.data(), wave_function(pulse), pitch, count, window);
+        assert(samples == expected);
+    }}
+
+    // merged samples interleave channels, padding short ones with silence
+    ChannelSamples channels = { { 1, 2, 3 }, {}, { 4 }, { 5, 6 } };
+    std::vector<Int16> merged = { 9, 9 };
+    merge_samples(channels, merged, ALL_POSSIBLE_SAMPLE_FRAMES);
+    assert((merged == std::vector<Int16>
+        { 1, 0, 4, 5,  2, 0, 0, 6,  3, 0, 0, 0 }));
+    for (const auto & samples : channels) assert(samples.empty());
+
+    NoteCache::run_tests();
+    NoiseLfsr::run_tests();
+
+    // notes played again come from the cache, and sound the same
+    Apu apu;
+    apu.enqueue(Channel::PULSE_ONE, ApuInstructionType::TEMPO, 10);
+    apu.enqueue(Channel::PULSE_TWO, ApuInstructionType::TEMPO, 10);
+    apu.enqueue(Channel::PULSE_TWO, ApuInstructionType::DUTY_CYCLE_WINDOW, 0x1B1B1B1B);
+    apu.process_instructions();
+    for (int i = 0; i != 2; ++i) {
+        apu.generate_note(Channel::PULSE_ONE, 440);
+        apu.generate_note(Channel::PULSE_TWO, 440);
+    }
+    assert(apu.m_note_cache.note_count() == 2);
+    const auto & pulse_one = apu.select_channel(Channel::PULSE_ONE);
+    const auto & pulse_two = apu.select_channel(Channel::PULSE_TWO);
+    assert(pulse_one.size() == 2*(SAMPLE_RATE / 10));
+    assert(std::equal(pulse_one.begin(), pulse_one.begin() + SAMPLE_RATE / 10,
+                      pulse_one.begin() + SAMPLE_RATE / 10));
+    assert(std::equal(pulse_two.begin(), pulse_two.begin() + SAMPLE_RATE / 10,
+                      pulse_two.begin() + SAMPLE_RATE / 10));
+    assert(pulse_one != pulse_two);
+
+    // samples which do not fit wait to be topped up, and reading an empty
+    // hand off is an underrun
+    {
+    std::unique_ptr<PcmHandOff> pcm(new PcmHandOff());
+    static constexpr const auto FRAME_SIZE = PcmHandOff::FRAME_SIZE;
+    std::vector<Int16> samples(PcmHandOff::CAPACITY - FRAME_SIZE, 1);
+    pcm->write(samples.data(), samples.size());
+    samples.assign(2*FRAME_SIZE, 2);
+    pcm->write(samples.data(), samples.size());
+    assert(pcm->available() == PcmHandOff::CAPACITY);
+    assert(pcm->backlog() == FRAME_SIZE);
+    std::vector<Int16> out(PcmHandOff::CAPACITY + 1);
+    assert(pcm->read(out.data(), out.size()) == PcmHandOff::CAPACITY);
+    assert(out[PcmHandOff::CAPACITY - 1] == 2);
+    pcm->top_up();
+    assert(pcm->backlog() == 0);
+    assert(pcm->read(out.data(), out.size()) == FRAME_SIZE);
+    assert(out[0] == 2);
+    assert(pcm->underruns() == 0);
+    assert(pcm->read(out.data(), out.size()) == 0);
+    assert(pcm->underruns() == 1);
+    assert(pcm->overruns() == 0);
+    // only a device a minute behind loses anything, the oldest first
+    samples.assign(PcmHandOff::CAPACITY + PcmHandOff::MAX_BACKLOG, 3);
+    samples.back() = 4;
+    pcm->write(samples.data(), samples.size());
+    samples.assign(FRAME_SIZE, 5);
+    pcm->write(samples.data(), samples.size());
+    assert(pcm->overruns() == FRAME_SIZE);
+    assert(pcm->backlog() == PcmHandOff::MAX_BACKLOG);
+    }
+    // every sample the APU makes goes through to the device
+    {
+    Apu apu;
+    apu.enqueue(Channel::TRIANGLE, ApuInstructionType::TEMPO, 10);
+    apu.enqueue(Channel::TRIANGLE, ApuInstructionType::NOTE, 440);
+    apu.update();
+    assert(apu.m_audio_device->pcm().available() == 0);
+    assert(apu.audio_device_stats().overruns  == 0);
+    assert(apu.audio_device_stats().underruns == 0);
+    }
+    // even a whole song queued at once (sample.efas's opening, more than the
+    // ring holds)
+    {
+    Apu apu;
+    apu.enqueue(Channel::TRIANGLE, ApuInstructionType::TEMPO, 4);
+    for (int pitch : { 375, 325, 275 })
+        apu.enqueue(Channel::TRIANGLE, ApuInstructionType::NOTE, pitch);
+    apu.enqueue(Channel::TRIANGLE, ApuInstructionType::TEMPO, 8);
+    for (int pitch : { 125, 125 })
+        apu.enqueue(Channel::TRIANGLE, ApuInstructionType::NOTE, pitch);
+    apu.update();
+    assert(apu.last_samples().size() > PcmHandOff::CAPACITY);
+    assert(apu.m_audio_device->pcm().available() == 0);
+    assert(apu.m_audio_device->pcm().backlog() == 0);
+    assert(apu.audio_device_stats().overruns == 0);
+    }
+    // noise is the same every time for the same seed, and either loud or
+    // silent
+    {
+    auto make_noise = [](UInt32 seed, NoiseMode mode) {
+        std::unique_ptr<Apu> apu(new Apu());
+        apu->seed_noise(seed);
+        apu->enqueue(Channel::NOISE, ApuInstructionType::TEMPO, 10);
+        apu->enqueue(Channel::NOISE, ApuInstructionType::NOISE_MODE, int(mode));
+        apu->process_instructions();
+        apu->generate_note(Channel::NOISE, 200);
+        apu->generate_note(Channel::NOISE, 200);
+        return apu->select_channel(Channel::NOISE);
+    };
+    auto noise = make_noise(1, NoiseMode::LONG_PERIOD);
+    assert(noise == make_noise(1, NoiseMode::LONG_PERIOD));
+    assert(noise != make_noise(2, NoiseMode::LONG_PERIOD));
+    assert(noise != make_noise(1, NoiseMode::SHORT_PERIOD));
+    for (auto sample : noise) assert(sample == 0 || mag(sample) == MAX / 4);
+    // the second note carries on with the register, rather than repeating
+    assert(!std::equal(noise.begin(), noise.begin() + SAMPLE_RATE / 10,
+                       noise.begin() + SAMPLE_RATE / 10));
+
+    Apu apu;
+    apu.enqueue(Channel::TRIANGLE, ApuInstructionType::NOISE_MODE, 1);
+    bool threw = false;
+    try { apu.update(); } catch (std::exception &) { threw = true; }
+    assert(threw);
+    apu.enqueue(Channel::NOISE, ApuInstructionType::NOISE_MODE, 2);
+    threw = false;
+    try { apu.update(); } catch (std::exception &) { threw = true; }
+    assert(threw);
+    (void)threw;
+    }
+}
+
 } // end of erfin namespace
 
 namespace {
 
+constexpr /* static */ const std::size_t PcmHandOff::CAPACITY;
+constexpr /* static */ const std::size_t PcmHandOff::FRAME_SIZE;
+constexpr /* static */ const std::size_t PcmHandOff::MAX_BACKLOG;
+
+void PcmHandOff::write(const Int16 * samples, std::size_t count) {
+    top_up();
+    if (backlog() == 0) {
+        // usually all of it fits, and nothing needs to wait
+        auto to_write = std::min(count, m_ring.room()) / FRAME_SIZE * FRAME_SIZE;
+        m_ring.push(samples, to_write);
+        samples += to_write;
+        count   -= to_write;
+    }
+    m_backlog.insert(m_backlog.end(), samples, samples + count);
+    if (backlog() > MAX_BACKLOG) {
+        auto to_drop = backlog() - MAX_BACKLOG;
+        m_backlog_start += to_drop;
+        m_overruns.fetch_add(to_drop);
+    }
+    if (m_backlog_start > m_backlog.size() / 2) {
+        remove_first(m_backlog, m_backlog_start);
+        m_backlog_start = 0;
+    }
+}
+
+void PcmHandOff::top_up() {
+    auto to_write = std::min(backlog(), m_ring.room()) / FRAME_SIZE * FRAME_SIZE;
+    m_ring.push(m_backlog.data() + m_backlog_start, to_write);
+    m_backlog_start += to_write;
+    if (m_backlog_start == m_backlog.size()) {
+        m_backlog.clear();
+        m_backlog_start = 0;
+    }
+}
+
+std::size_t PcmHandOff::read(Int16 * samples, std::size_t max_count) {
+    std::size_t count = 0;
+    while (count != max_count) {
+        auto span = m_ring.front_span();
+        if (span.size == 0) break;
+        auto to_copy = std::min(span.size, max_count - count);
+        std::copy(span.data, span.data + to_copy, samples + count);
+        m_ring.pop(to_copy);
+        count += to_copy;
+    }
+    if (count == 0) m_underruns.fetch_add(1);
+    return count;
+}
+
 using DutyCycleFunction = Int16(*)(Int16);
 
 class DutyCycleIterator {
@@ -240,7 +594,12 @@ public:
 
     DutyCycleFunction duty_cycle_function() const;
 
+    /** @return highest wave position the duty cycle function lets through */
+    Int16 threshold() const;
+
 private:
+    int value() const;
+
     int m_position;
     const DutyCycleWindow * m_duty_cycle_window;
 };
@@ -260,8 +619,40 @@ void do_n_times_until(int n, Func && f) {
     do { if (f() == DoNTimes::BREAK) break; } while(--n);
 }
 
+template <typename SampleFunc>
+void synthesize_note
+    (Int16 * samples, SampleFunc sample_function, int pitch,
+     int samples_count, const DutyCycleWindow & duty_cycles)
+{
+    static_assert(std::is_same<decltype(sample_function(0, 0)), Int16>::value, "");
+    // zero hertz is taken as silence (and so is a wave which never finishes a
+    // period)
+    const int period = pitch > 0 ? 2*MAX_AMP / pitch + 1 : samples_count + 1;
+    const int periods = samples_count / period;
+
+    // a note finishes on the last sample of its last whole period (that
+    // sample included), anything after is silent
+    const int sounding = periods == 0 ? 0 : periods*period - 1;
+    DutyCycleIterator dci(duty_cycles);
+    for (int start = 0; start < sounding; start += period) {
+        // Duty cycles cut off the end of each period, which is where the
+        // wave position passes the threshold. The wave position is computed
+        // from the sample's place in the period, so this vectorizes.
+        const int threshold = dci.threshold();
+        const int end = std::min(start + period, sounding);
+        Int16 * out = samples + start;
+        for (int i = 0; i != end - start; ++i) {
+            int wave_position = -MAX_AMP + i*pitch;
+            out[i] = wave_position > threshold ?
+                     Int16(0) : sample_function(Int16(wave_position), start + i);
+        }
+        ++dci;
+    }
+    std::fill(samples + sounding, samples + samples_count, Int16(0));
+}
+
 template <typename BaseWaveFunc>
-void generate_note_full
+void generate_note_full_by_loop
     (std::vector<Int16> & samples, BaseWaveFunc base_function,
      int pitch, int samples_count, const DutyCycleWindow duty_cycles)
 {
@@ -313,36 +704,27 @@ namespace erfin {
 
 #ifndef MACRO_BUILD_STL_ONLY
 
-SfmlAudioDevice::SfmlAudioDevice() {
+SfmlAudioDevice::SfmlAudioDevice():
+    m_chunk(AUDIO_CHUNK_SIZE)
+{
     initialize(unsigned(Channel::COUNT), ApuAttorney::SAMPLE_RATE);
 }
 
-void SfmlAudioDevice::upload_samples(const std::vector<Int16> & samples_) {
-    std::unique_lock<std::mutex> lock(m_samples_mutex);
-    (void)lock;
-    m_samples.insert(m_samples.end(), samples_.begin(), samples_.end());
-    if (!m_samples.empty() && getStatus() == Stopped)
+void SfmlAudioDevice::upload_samples(const Int16 * samples, std::size_t count) {
+    m_pcm.write(samples, count);
+    if (count != 0 && getStatus() == Stopped)
         play();
 }
 
 /* private override final */ bool SfmlAudioDevice::onGetData(Chunk & data) {
-    {
-    std::unique_lock<std::mutex> lock(m_samples_mutex);
-    (void)lock;
-
-    m_samples_hot.swap(m_samples);
-    m_samples.clear();
-    }
-    if (m_samples_hot.empty()) {
-        m_samples_hot.resize(1000, 0);
+    auto count = m_pcm.read(m_chunk.data(), m_chunk.size());
+    if (count == 0) {
+        // the APU fell behind, play a little silence rather than stopping
+        count = 1000;
+        std::fill(m_chunk.begin(), m_chunk.begin() + count, Int16(0));
     }
-    if (m_samples_hot.empty()) {
-        return false;
-    } else {
-        data.sampleCount =  m_samples_hot.size();
-        data.samples     = &m_samples_hot.front();
-    }
-
+    data.sampleCount = count;
+    data.samples     = m_chunk.data();
     return true;
 }
 
@@ -364,22 +746,13 @@ void DutyCycleIterator::operator ++ () {
                  int(DUTY_CYCLE_WINDOW_SIZE);
 }
 
-DutyCycleFunction DutyCycleIterator::duty_cycle_function() const {
-    static_assert(BITS_PER_DUTY_CYCLE_FUNCTION == 2,
-                  "This function needs to be fixed to take into account "
-                  "for the new 'sub-window' size.");
+// careful not to overflow!
+constexpr const Int16 THIRD_THERSHOLD = -2*(MAX_AMP / 3);
+constexpr const Int16 QUART_THERSHOLD = -  (MAX_AMP / 2);
 
+DutyCycleFunction DutyCycleIterator::duty_cycle_function() const {
     using DO = erfin::DutyCycleOption;
-
-    const auto pos = std::size_t(m_position);
-    int value = int(m_duty_cycle_window->test(pos)) |
-                int(m_duty_cycle_window->test(pos + 1)) << 1;
-
-    // careful not to overflow!
-    static constexpr const Int16 THIRD_THERSHOLD = -2*(MAX_AMP / 3);
-    static constexpr const Int16 QUART_THERSHOLD = -  (MAX_AMP / 2);
-
-    switch (static_cast<DO>(value)) {
+    switch (static_cast<DO>(value())) {
     case DO::FULL_WAVE: return [](Int16) -> Int16 { return 1; };
     case DO::ONE_HALF:
         return [](Int16 x) -> Int16 { return (x > 0) ? 0 : 1; };
@@ -393,4 +766,26 @@ DutyCycleFunction DutyCycleIterator::duty_cycle_function() const {
     }
 }
 
+Int16 DutyCycleIterator::threshold() const {
+    using DO = erfin::DutyCycleOption;
+    switch (static_cast<DO>(value())) {
+    case DO::FULL_WAVE  : return MAX_AMP;
+    case DO::ONE_HALF   : return 0;
+    case DO::ONE_THIRD  : return THIRD_THERSHOLD;
+    case DO::ONE_QUARTER: return QUART_THERSHOLD;
+    default:
+        assert(false);
+        throw std::runtime_error("Impossible branch?!");
+    }
+}
+
+/* private */ int DutyCycleIterator::value() const {
+    static_assert(BITS_PER_DUTY_CYCLE_FUNCTION == 2,
+                  "This function needs to be fixed to take into account "
+                  "for the new 'sub-window' size.");
+    const auto pos = std::size_t(m_position);
+    return int(m_duty_cycle_window->test(pos)) |
+           int(m_duty_cycle_window->test(pos + 1)) << 1;
+}
+
 } // end of <anonymous> namespace
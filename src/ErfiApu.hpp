@@ -25,20 +25,20 @@
 #include <limits>
 
 #include <vector>
-#include <queue>
-#include <random>
 #include <bitset>
 
 #include <cstdint>
 
 #include "ErfiDefs.hpp"
+#include "SpscRing.hpp"
+#include "ApuPrivate/NoteCache.hpp"
+#include "ApuPrivate/NoiseLfsr.hpp"
 
 namespace erfin {
 
 class SfmlAudioDevice;
 
 // Dev notes:
-// unimplemented: duty-cycles, noise channel
 // duty-cycles
 // - as multipliers?
 // - - one for "full-on" then
@@ -65,6 +65,13 @@ public:
     // PSG-like
     // follows same principles involving a command buffer
     // involuntarily multi-threaded (by API designer)
+
+    /** Most words the command stream holds between updates. */
+    static constexpr const std::size_t COMMAND_CAPACITY = 1 << 12;
+
+    // "Hardware" fixed sample rate
+    static constexpr const int SAMPLE_RATE = 11025;
+
     Apu();
 
     ~Apu();
@@ -75,19 +82,46 @@ public:
 
     void update();
 
-    void io_write(UInt32);
+    // @return false if the command stream is full (the word is dropped)
+    bool io_write(UInt32);
+
+    struct AudioDeviceStats {
+        std::size_t overruns;  // samples dropped, the device fell over a
+                               // minute behind
+        std::size_t underruns; // times the device ran out of samples
+    };
+
+    AudioDeviceStats audio_device_stats() const;
+
+    /** Reseeds the noise channel's shift register (see NoiseLfsr::seed),
+     *  which starts at NoiseLfsr::DEFAULT_SEED.
+     */
+    void seed_noise(UInt32 seed) { m_noise.seed(UInt16(seed)); }
+
+    /** @return samples made by the last update, interleaved one channel
+     *          after another (as the device plays them)
+     */
+    const std::vector<std::int16_t> & last_samples() const { return m_samples; }
+
+    /** Samples are still made with the device off (see last_samples), they
+     *  just are not played.
+     */
+    void set_audio_device_enabled(bool on) { m_device_enabled = on; }
+
+    static void run_tests();
 
 private:
     // ------------------------------------------------------------------------
 
-    // "Hardware" fixed sample rate
-    static constexpr const int SAMPLE_RATE = 11025;
-
     using DutyCycleWindow  = std::bitset<sizeof(int32_t)*8>;
-    using InstructionQueue = std::queue<UInt32>;
+    using InstructionQueue = SpscRing<UInt32, COMMAND_CAPACITY>;
 
     static const constexpr int ALL_POSSIBLE_SAMPLE_FRAMES = -1;
 
+    // sample buffers are reserved for this many samples per channel up
+    // front, and keep their memory between updates
+    static constexpr const std::size_t PREALLOCATED_SAMPLES = SAMPLE_RATE;
+
     // channel stuff
     using Int16 = std::int16_t;
     struct ChannelInfo {
@@ -118,7 +152,9 @@ private:
     ChannelNoteInfo m_channel_info;
     ChannelSamples m_samples_per_channel;
     SfmlAudioDevice * m_audio_device;
-    std::default_random_engine m_rng;
+    bool m_device_enabled;
+    NoiseLfsr m_noise;
+    NoteCache m_note_cache;
 };
 
 class ApuAttorney {
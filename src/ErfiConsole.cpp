@@ -53,7 +53,9 @@ UtilityDevices::UtilityDevices():
     m_halt_flag(false),
     m_bus_error(false),
     m_rng(std::random_device()()),
-    m_prev_time(std::chrono::steady_clock::now())
+    m_prev_time(std::chrono::steady_clock::now()),
+    m_wait_time(0),
+    m_virtual_time_step(0)
 {}
 
 // read actions
@@ -78,11 +80,15 @@ bool UtilityDevices::halt_requested() const { return m_halt_flag; }
 
 void UtilityDevices::set_wait_time() {
     using namespace std::chrono;
-    auto duration = duration_cast<milliseconds>(steady_clock::now() - m_prev_time);
-    auto et       = double(duration.count()) / 1000.0;
-    m_prev_time   = steady_clock::now();
-    m_wait        = false;
-    m_wait_time   = to_fixed_point(et);
+    if (m_virtual_time_step) {
+        m_wait_time = m_virtual_time_step;
+    } else {
+        auto now      = steady_clock::now();
+        auto duration = duration_cast<milliseconds>(now - m_prev_time);
+        m_prev_time   = now;
+        m_wait_time   = to_fixed_point(double(duration.count()) / 1000.0);
+    }
+    m_wait = false;
     update_no_stop_signal();
 }
 
@@ -103,6 +109,8 @@ void do_write(ConsolePack & con, UInt32 address, UInt32 data) {
         do_device_write(con, address, data);
     } else if (address < con.ram->size()) {
         (*con.ram)[address] = data;
+        // program may be modifying itself
+        con.cpu->invalidate_inst_cache(address);
     } else {
         throw Error(ACCESS_VIOLATION_MESSAGE);
     }
@@ -129,7 +137,9 @@ bool address_is_valid(const ConsolePack & con, UInt32 address) {
     }
 }
 
-Console::Console() {
+Console::Console():
+    m_instruction_count(0)
+{
     pack.apu = &m_apu;
     pack.ram = &m_ram;
     pack.cpu = &m_cpu;
@@ -141,6 +151,8 @@ Console::Console() {
 
 void Console::load_program(const ProgramData & program) {
     load_program_to_memory(program, *pack.ram);
+    pack.cpu->clear_inst_cache();
+    m_instruction_count = 0;
 }
 
 void Console::process_event(const sf::Event & event) {
@@ -163,6 +175,18 @@ void Console::press_restart() {
     pack.cpu->reset();
 }
 
+void Console::run_until_wait(std::size_t budget) {
+    start_frame();
+    while (budget) {
+        auto executed = pack.cpu->run_cycles(pack, budget);
+        if (executed == 0) break;
+        m_instruction_count += executed;
+        if (budget != ErfiCpu::UNLIMITED_BUDGET) budget -= executed;
+    }
+    check_for_trap();
+}
+
+
 bool Console::trying_to_shutdown() const {
     return pack.dev->halt_requested();
 }
@@ -179,6 +203,20 @@ const Console::VideoMemory & Console::current_screen() const {
     return pack.gpu->current_screen();
 }
 
+const Console::DamageList & Console::screen_damage() const {
+    return pack.gpu->screen_damage();
+}
+
+const std::vector<std::int16_t> & Console::audio_samples() const {
+    return pack.apu->last_samples();
+}
+
+void Console::set_audio_device_enabled(bool on) {
+    pack.apu->set_audio_device_enabled(on);
+}
+
+void Console::flush_audio() { pack.apu->update(); }
+
 /* static */ void Console::load_program_to_memory
     (const ProgramData & program, MemorySpace & memspace)
 {
@@ -190,6 +228,17 @@ const Console::VideoMemory & Console::current_screen() const {
         *beg++ = serialize(inst);
 }
 
+/* private */ void Console::start_frame() {
+    pack.gpu->wait(*pack.ram);
+    pack.apu->update();
+    pack.dev->set_wait_time();
+}
+
+/* private */ void Console::check_for_trap() const {
+    if (pack.cpu->trap() == ErfiCpu::Trap::NONE) return;
+    throw ErfiCpuError(pack.cpu->trap_address(), pack.cpu->trap_message());
+}
+
 } // end of erfin namespace
 
 namespace {
@@ -242,9 +291,9 @@ void do_device_write
 
     switch (address) {
     case RESERVED_NULL          : bus_error(); return;
-    case GPU_INPUT_STREAM       : con.gpu->io_write(data); return;
+    case GPU_INPUT_STREAM       : if (!con.gpu->io_write(data)) bus_error(); return;
     case GPU_RESPONSE           : bus_error(); return;
-    case APU_INPUT_STREAM       : con.apu->io_write(data); return;
+    case APU_INPUT_STREAM       : if (!con.apu->io_write(data)) bus_error(); return;
     case TIMER_WAIT_AND_SYNC    : if (data) con.dev->wait(data); return;
     case TIMER_QUERY_SYNC_ET    :
     case RANDOM_NUMBER_GENERATOR:
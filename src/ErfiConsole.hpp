@@ -30,6 +30,7 @@
 #include "ErfiGamePad.hpp"
 
 #include <chrono>
+#include <random>
 #include <utility>
 #include <iosfwd>
 
@@ -60,6 +61,18 @@ public:
 
     void set_wait_time();
 
+    /** Switches the timer to virtual time, where every wait reports the
+     *  same elapsed time (a fixed point number of seconds) regardless of
+     *  how long the frame actually took. A step of zero goes back to
+     *  measuring wall clock time.
+     */
+    void set_virtual_time_step(UInt32 fp_seconds)
+        { m_virtual_time_step = fp_seconds; }
+
+    bool on_virtual_time() const { return m_virtual_time_step != 0; }
+
+    void seed_rng(UInt32 seed) { m_rng.seed(seed); }
+
     void set_bus_error(bool v) { m_bus_error = v; }
 
     bool bus_error_present() const { return m_bus_error; }
@@ -75,6 +88,7 @@ private:
     std::uniform_int_distribution<UInt32> m_distro;
     TimePoint m_prev_time;
     UInt32 m_wait_time;
+    UInt32 m_virtual_time_step;
 };
 
 struct ConsolePack {
@@ -97,6 +111,7 @@ bool address_is_valid(const ConsolePack &, UInt32 address);
 class Console {
 public:
     using VideoMemory = ErfiGpu::VideoMemory;
+    using DamageList  = ErfiGpu::DamageList;
 
     Console();
 
@@ -111,7 +126,31 @@ public:
     template <typename Func>
     void run_until_wait_with_post_frame(Func && f);
 
-    void run_until_wait() { run_until_wait_with_post_frame([](){}); }
+    /** Runs the CPU with its selected dispatcher until the next wait/halt,
+     *  nothing is called between instructions.
+     *  @param budget stops early after executing this many instructions
+     */
+    void run_until_wait(std::size_t budget = ErfiCpu::UNLIMITED_BUDGET);
+
+    /** @return instructions executed by run_until_wait since the program
+     *          was loaded
+     */
+    std::size_t instruction_count() const { return m_instruction_count; }
+
+    void set_cpu_dispatcher(ErfiCpu::Dispatcher dispatcher)
+        { m_cpu.set_dispatcher(dispatcher); }
+
+    /** Puts the timer on virtual time, each frame then takes exactly the
+     *  given (fixed point) number of seconds, zero goes back to the wall
+     *  clock. See UtilityDevices::set_virtual_time_step.
+     */
+    void set_virtual_time_step(UInt32 fp_seconds_per_frame)
+        { m_dev.set_virtual_time_step(fp_seconds_per_frame); }
+
+    bool on_virtual_time() const { return m_dev.on_virtual_time(); }
+
+    /** Seeds both the RNG device and the APU's noise channel. */
+    void seed_rng(UInt32 seed) { m_dev.seed_rng(seed); m_apu.seed_noise(seed); }
 
     void update_with_current_state(Debugger &) const;
 
@@ -119,10 +158,34 @@ public:
 
     const VideoMemory & current_screen() const;
 
+    /** @return rows of the current screen which changed on the last frame
+     *          (see ErfiGpu::screen_damage)
+     */
+    const DamageList & screen_damage() const;
+
+    /** @return samples the APU made on the last frame (see
+     *          Apu::last_samples)
+     */
+    const std::vector<std::int16_t> & audio_samples() const;
+
+    /** Turns playing audio on or off, it is still made either way. */
+    void set_audio_device_enabled(bool on);
+
+    /** Has the APU make samples for everything sent to it since the frame
+     *  started, which otherwise waits for the next frame (useful once the
+     *  program halts).
+     */
+    void flush_audio();
+
     static void load_program_to_memory
         (const ProgramData & program, MemorySpace & memspace);
 
 private:
+    void start_frame();
+
+    // throws an ErfiCpuError if the CPU has stopped on a trap
+    void check_for_trap() const;
+
     ConsolePack pack;
 
     MemorySpace    m_ram;
@@ -131,17 +194,17 @@ private:
     Apu            m_apu;
     GamePad        m_pad;
     UtilityDevices m_dev;
+
+    std::size_t m_instruction_count;
 };
 
 template <typename Func>
 void Console::run_until_wait_with_post_frame(Func && f) {
-    pack.gpu->wait(*pack.ram);
-    pack.apu->update();
-    pack.dev->set_wait_time();
-    while (pack.dev->no_stop_signal()) {
-        pack.cpu->run_cycle(pack);
+    start_frame();
+    // one instruction at a time, so f sees every step
+    while (pack.cpu->run_cycles(pack, 1))
         f();
-    }
+    check_for_trap();
 }
 
 } // end of erfin namespace
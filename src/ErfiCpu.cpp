@@ -43,6 +43,10 @@
 #   error "no compiler defined"
 #endif
 
+#if defined(MACRO_COMPILER_GCC) || defined(MACRO_COMPILER_CLANG)
+#   define MACRO_HAS_COMPUTED_GOTO
+#endif
+
 namespace {
 
 using Error = std::runtime_error;
@@ -61,18 +65,43 @@ UInt32 xori (UInt32 x, UInt32 y) { return x ^ y; }
 
 UInt32 rotate(UInt32 x, UInt32 y);
 
+// divisors must not be zero, callers raise a trap instead
+bool is_fp_zero(UInt32 x);
 UInt32 div_fp  (UInt32 x, UInt32 y);
 UInt32 div_int (UInt32 x, UInt32 y);
 UInt32 mod_fp  (UInt32 x, UInt32 y);
 UInt32 mod_int (UInt32 x, UInt32 y);
 UInt32 comp_int(UInt32 x, UInt32 y);
 
+constexpr const UInt32 MEMORY_WORDS =
+    UInt32(std::tuple_size<erfin::MemorySpace>::value);
+
+// Plain RAM is accessed directly, only device addresses go through the
+// console's MMIO dispatcher.
+// A single unsigned comparison also rules out device addresses, as they
+// all have their most significant bit set.
+// Both return false (and access nothing) if the address is neither.
+bool read_memory(erfin::ConsolePack & con, UInt32 address, UInt32 & out);
+
+bool write_memory(erfin::ConsolePack & con, UInt32 address, UInt32 data);
+
 } // end of <anonymous> namespace
 
 namespace erfin {
 
-ErfiCpu::ErfiCpu()
-    { reset(); }
+constexpr /* static */ const ErfiCpu::Dispatcher ErfiCpu::DEFAULT_DISPATCHER;
+constexpr /* static */ const std::size_t ErfiCpu::UNLIMITED_BUDGET;
+constexpr /* static */ const UInt32 ErfiCpu::MAX_BLOCK_LENGTH;
+constexpr /* static */ const int ErfiCpu::MAX_FUSED_STACK_OP;
+
+ErfiCpu::ErfiCpu():
+    m_inst_cache(MEMORY_WORDS),
+    m_dispatcher(DEFAULT_DISPATCHER),
+    m_block_insts(1),
+    m_block_index(MEMORY_WORDS, 0),
+    m_block_coverage(MEMORY_WORDS, 0),
+    m_leave_block(false)
+{ reset(); }
 
 void ErfiCpu::reset() {
     // std::array does not initialize values
@@ -80,60 +109,66 @@ void ErfiCpu::reset() {
     // attempting to find issue
     // failed guess -> std::fill here fails to write zeros
     std::fill(m_registers.begin(), m_registers.end(), 0);
+    m_trap         = Trap::NONE;
+    m_trap_address = 0;
+    m_trap_detail  = 0;
 }
 
-void ErfiCpu::run_cycle(ConsolePack & console) {
-    auto & pc_reg = m_registers[std::size_t(Reg::PC)];
-    if (pc_reg >= console.ram->size()) {
-        throw ErfiCpuError(pc_reg,
-            "Failed to decode instruction at invalid address. Note that the "
-            "PC cannot load instructions from devices. (Perhaps a bad SET pc "
-            "instruction?)");
+void ErfiCpu::run_cycle(ConsolePack & console)
+    { step(m_registers.data(), console); }
+
+void ErfiCpu::run_cycle(Inst inst, ConsolePack & console)
+    { execute(m_registers.data(), decode(inst), console); }
+
+std::size_t ErfiCpu::run_cycles(ConsolePack & console, std::size_t budget) {
+    assert(console.cpu == this);
+    if (m_trap != Trap::NONE) return 0;
+    RegisterPack regs = m_registers;
+    std::size_t executed = 0;
+    // CPU faults are trapped, but devices may still throw
+    try {
+        switch (m_dispatcher) {
+        case Dispatcher::SWITCH  :
+            executed = run_switched(regs.data(), console, budget);
+            break;
+        case Dispatcher::THREADED:
+            executed = run_threaded(regs.data(), console, budget);
+            break;
+        }
+    } catch (...) {
+        // registers must reflect the instruction which failed
+        m_registers = regs;
+        throw;
     }
+    m_registers = regs;
+    return executed;
+}
 
-    run_cycle(deserialize((*console.ram)[pc_reg++]), console);
+std::string ErfiCpu::trap_message() const {
+    switch (m_trap) {
+    case Trap::NONE: return "No trap was raised.";
+    case Trap::ILLEGAL_INSTRUCTION:
+        return disassemble_instruction(deserialize(m_trap_detail));
+    case Trap::INVALID_PC:
+        return "Failed to decode instruction at invalid address. Note that "
+               "the PC cannot load instructions from devices. (Perhaps a bad "
+               "SET pc instruction?)";
+    case Trap::ACCESS_VIOLATION:
+        return "Memory access violation (address is too high).";
+    case Trap::DIVIDE_BY_ZERO: return "Attempted to divide by zero.";
+    }
+    std::terminate();
 }
 
-void ErfiCpu::run_cycle(Inst inst, ConsolePack & console) {
-    // ------------------- This is inside a HOT LOOP --------------------------
-    using O = OpCode;
-    switch (decode_op_code(inst)) {
-    // R-type type indifferent split by pf (1-bit) (integer only)
-    // PLUS, MINUS, AND, XOR, OR, ROTATE
-    case O::PLUS   : do_arth<plus       , plus    >(inst); return;
-    case O::MINUS  : do_arth<minus      , minus   >(inst); return;
-    case O::AND    : do_arth<andi       , andi    >(inst); return;
-    case O::XOR    : do_arth<xori       , xori    >(inst); return;
-    case O::OR     : do_arth<ori        , ori     >(inst); return;
-    case O::ROTATE : do_arth<rotate     , rotate  >(inst); return;
-    // R-type split by is_fp (1-bit) and pf (1-bit)
-    // TIMES, DIVIDE, MODULUS, COMP
-    case O::TIMES  : do_arth<fp_multiply, times   >(inst); return;
-    case O::DIVIDE : do_arth<div_fp     , div_int >(inst); return;
-    case O::MODULUS: do_arth<mod_fp     , mod_int >(inst); return;
-    case O::COMP   : do_arth<fp_compare , comp_int>(inst); return;
-    // M-type (2bits for pf, 0 bits for is_fp) (set types)
-    // SET, SAVE, LOAD
-    case O::SET : do_set(inst); return;
-    case O::SAVE: do_write(console, get_move_op_address(inst), reg0(inst)); return;
-    case O::LOAD: reg0(inst) = do_read(console, get_move_op_address(inst)); return;
-    // J-type (reducable to 0-bits for "pf")
-    // SKIP (make default immd 0b1111 ^ NOT_EQUAL)
-    case O::SKIP: do_skip(inst         ); return;
-    case O::CALL: do_call(inst, console); return;
-    // "O"-types (0 bits for "pf") (odd-out types)
-    // NOT
-    case O::NOT: do_not(inst); return;
-    default: throw_error(inst); // throws
-    };
+void ErfiCpu::clear_inst_cache() {
+    std::fill(m_inst_cache.begin(), m_inst_cache.end(), DecodedInst());
+    flush_blocks();
 }
 
 void ErfiCpu::update_debugger(Debugger & dbgr) const {
     dbgr.update_internals(m_registers);
 }
 
-void try_program(const char * source_code, const int inst_limit_c);
-
 /* static */ void ErfiCpu::run_tests() {
     try_program(
         "     assume integer \n"
@@ -174,6 +209,226 @@ void try_program(const char * source_code, const int inst_limit_c);
         "     pop a b c x y z\n"
         ":safety-loop set pc safety-loop\n"
         ":stack-start data [________ ________ ________ ________]", 30);
+    // self modifying programs must not run stale decoded instructions
+    {
+    auto regs = try_program(
+        "         assume integer\n"
+        "         set  c 0\n"
+        ":target  set  a 1\n"
+        "         skip c\n"
+        "         jump patch-it\n"
+        ":safety-loop set pc safety-loop\n"
+        ":patch-it\n"
+        "         set  c 1\n"
+        "         set  z 0\n"
+        "         load b z patch\n"
+        "         save b target\n"
+        "         jump target\n"
+        ":patch   set  a 2\n", 15);
+    assert(regs[std::size_t(Reg::A)] == 2);
+    (void)regs;
+    }
+    // both dispatchers must agree on the result of a halting program
+    {
+    const char * const src =
+        "     assume integer\n"
+        "     set  sp stack\n"
+        "     set  x 0\n"
+        "     set  y 100\n"
+        ":inc add  x 3\n"
+        "     call dbl\n"
+        "     comp a x y\n"
+        "     skip a >=\n"
+        "     jump inc\n"
+        "     io halt a\n"
+        ":dbl push x\n"
+        "     times b x 2\n"
+        "     pop  x\n"
+        "     pop  pc\n"
+        ":stack data [________ ________ ________ ________]";
+    auto switched = run_until_halt(src, Dispatcher::SWITCH  );
+    auto threaded = run_until_halt(src, Dispatcher::THREADED);
+    assert(switched == threaded);
+    assert(threaded[std::size_t(Reg::X)] == 102);
+    assert(threaded[std::size_t(Reg::B)] == 204);
+    (void)switched; (void)threaded;
+    }
+    // and on the instructions counted, when a push stops part way (here by
+    // writing over its own translated code)
+    {
+    const char * const src =
+        "set  sp 0\n"
+        "set  x 5\n"
+        "push x y z a\n"
+        "io   halt x\n";
+    std::size_t executed[2];
+    auto switched = run_until_halt(src, Dispatcher::SWITCH  , &executed[0]);
+    auto threaded = run_until_halt(src, Dispatcher::THREADED, &executed[1]);
+    assert(switched == threaded);
+    assert(executed[0] == executed[1] && executed[0] == 9);
+    (void)switched; (void)threaded; (void)executed;
+    }
+    // budgets are respected exactly, whatever the dispatcher
+    {
+    Assembler asmr;
+    asmr.assemble_from_string(
+        "     assume integer\n"
+        "     set  sp stack\n"
+        ":inc add  x 1\n"
+        "     push x y\n"
+        "     pop  y x\n"
+        "     comp a x 1000\n"
+        "     skip a >=\n"
+        "     jump inc\n"
+        "     io halt a\n"
+        ":stack data [________ ________ ________ ________\n"
+        "             ________ ________ ________ ________]");
+    for (std::size_t budget : { 0, 1, 5, 63, 64, 65, 200, 10001, 10002, 20000 }) {
+        RegisterPack regs[2];
+        std::size_t executed[2];
+        for (int i = 0; i != 2; ++i) {
+            MemorySpace mem;
+            ErfiCpu cpu;
+            UtilityDevices dev;
+            ConsolePack con; con.cpu = &cpu; con.ram = &mem; con.dev = &dev;
+            for (UInt32 & w : mem) w = 0;
+            Console::load_program_to_memory(asmr.program_data(), mem);
+            cpu.set_dispatcher(i ? Dispatcher::THREADED : Dispatcher::SWITCH);
+            executed[i] = cpu.run_cycles(con, budget);
+            regs[i] = cpu.m_registers;
+        }
+        assert(executed[0] == executed[1] && regs[0] == regs[1]);
+        // the program halts after 1 + 999*10 + 9 + 2 instructions
+        assert(executed[0] == std::min(budget, std::size_t(10002)));
+        (void)executed;
+    }
+    }
+    // translated blocks must be dropped when the program modifies itself
+    {
+    const char * const src =
+        "         assume integer\n"
+        "         set  c 0\n"
+        ":target  set  a 1\n"
+        "         skip c\n"
+        "         jump patch-it\n"
+        "         io   halt c\n"
+        ":patch-it\n"
+        "         set  c 1\n"
+        "         set  z 0\n"
+        "         load b z patch\n"
+        "         save b target\n"
+        "         jump target\n"
+        ":patch   set  a 2\n";
+    auto switched = run_until_halt(src, Dispatcher::SWITCH  );
+    auto threaded = run_until_halt(src, Dispatcher::THREADED);
+    assert(switched == threaded);
+    assert(threaded[std::size_t(Reg::A)] == 2);
+    (void)switched; (void)threaded;
+    }
+    // common sequences are fused into single superinstructions
+    {
+    using D = DecodedOp;
+    Assembler asmr;
+    MemorySpace mem;
+    ErfiCpu cpu;
+    asmr.assemble_from_string(
+        "     assume integer\n"
+        ":inc add  x 5\n"
+        "     push a b c\n"
+        "     pop  a b c\n"
+        "     comp a x y\n"
+        "     skip a >=\n"
+        "     jump inc\n");
+    for (UInt32 & i : mem) i = 0;
+    Console::load_program_to_memory(asmr.program_data(), mem);
+    const DecodedInst * block = cpu.block_at(0, mem);
+    const D expected[] = { D::PLUS_2R_IMMD, D::PUSH, D::POP,
+                           D::COMP_SKIP_JUMP_3R_INT, D::END_BLOCK };
+    for (D op : expected) {
+        assert((block++)->op == op);
+        (void)op;
+    }
+    // an untranslated word is dropped without flushing anything
+    cpu.invalidate_inst_cache(MEMORY_WORDS - 1);
+    assert(!cpu.m_leave_block);
+    cpu.invalidate_inst_cache(2);
+    assert(cpu.m_leave_block && cpu.m_block_index[0] == 0);
+    }
+    // only immediate addresses outside of RAM take the MMIO path
+    {
+    using D = DecodedOp;
+    using namespace device_addresses;
+    assert(decode(encode(OpCode::SAVE, Reg::A, encode_immd_addr(10))).op ==
+           D::SAVE_1R_RAM);
+    assert(decode(encode(OpCode::LOAD, Reg::A, encode_immd_addr(10))).op ==
+           D::LOAD_1R_RAM);
+    assert(decode(encode(OpCode::SAVE, Reg::A, encode_immd_addr(HALT_SIGNAL)))
+           .op == D::SAVE_1R_INT);
+    // a register address outside of RAM still fails
+    MemorySpace mem;
+    ErfiCpu cpu;
+    ConsolePack con; con.cpu = &cpu; con.ram = &mem;
+    cpu.m_registers[std::size_t(Reg::B)] = MEMORY_WORDS;
+    cpu.m_registers[std::size_t(Reg::PC)] = 1;
+    cpu.run_cycle(encode(OpCode::LOAD, Reg::A, Reg::B), con);
+    assert(cpu.trap() == Trap::ACCESS_VIOLATION && cpu.trap_address() == 0);
+    }
+    // faults stop both dispatchers on the same instruction, with the same
+    // registers, rather than throwing
+    {
+    struct TrapCase {
+        const char * source;
+        Trap trap;
+        UInt32 address;
+    };
+    const TrapCase cases[] = {
+        { "assume integer\n set a 10\n set b 0\n set c 1\n div a a b\n",
+          Trap::DIVIDE_BY_ZERO, 3 },
+        { "assume fixed-point\n set a 1.5\n set b 0\n mod a a b\n",
+          Trap::DIVIDE_BY_ZERO, 2 },
+        // stack pointer at the last word of RAM, the second push faults
+        { "assume integer\n set sp 16382\n set a 1\n set b 2\n"
+          " push a b\n set c 3\n",
+          Trap::ACCESS_VIOLATION, 4 },
+        { "assume integer\n set a 0\n minus a a 1\n set pc a\n",
+          Trap::INVALID_PC, 0xFFFFFFFF },
+        // an undecodable word in place of "set c 2"
+        { "assume integer\n set a 1\n set b 1\n set c 2\n",
+          Trap::ILLEGAL_INSTRUCTION, 2 },
+        // the fourth word of the push faults, after three have run
+        { "assume integer\n set sp 8190\n times sp sp 2\n set x 5\n"
+          " push x y z a\n io halt x\n",
+          Trap::ACCESS_VIOLATION, 6 },
+        // the first load of the pop faults, after the stack pointer moved
+        { "assume integer\n set sp 8193\n times sp sp 2\n pop x y z\n",
+          Trap::ACCESS_VIOLATION, 3 }
+    };
+    for (const auto & tc : cases) {
+        RegisterPack regs[2];
+        std::size_t executed[2];
+        for (int i = 0; i != 2; ++i) {
+            Assembler asmr;
+            MemorySpace mem;
+            ErfiCpu cpu;
+            UtilityDevices dev;
+            ConsolePack con; con.cpu = &cpu; con.ram = &mem; con.dev = &dev;
+            asmr.assemble_from_string(tc.source);
+            for (UInt32 & w : mem) w = 0;
+            Console::load_program_to_memory(asmr.program_data(), mem);
+            if (tc.trap == Trap::ILLEGAL_INSTRUCTION) mem[2] = 0xFFFFFFFF;
+            cpu.set_dispatcher(i ? Dispatcher::THREADED : Dispatcher::SWITCH);
+            executed[i] = cpu.run_cycles(con, UNLIMITED_BUDGET);
+            assert(cpu.trap() == tc.trap);
+            assert(cpu.trap_address() == tc.address);
+            // a pending trap runs nothing more
+            assert(cpu.run_cycles(con, UNLIMITED_BUDGET) == 0);
+            regs[i] = cpu.m_registers;
+        }
+        // the faulting instruction is not counted, what ran before it is
+        assert(regs[0] == regs[1] && executed[0] == executed[1]);
+        (void)regs; (void)executed;
+    }
+    }
     assert(mod_int(UInt32(-1), UInt32(-1)) == 0);
     assert(mod_int( 3,  2) == 1);
     assert(mod_int( 7,  4) == 7 % 4);
@@ -181,7 +436,9 @@ void try_program(const char * source_code, const int inst_limit_c);
     assert(int(mod_int(UInt32( 7), UInt32(-4))) == -(7 % 4));
 }
 
-void try_program(const char * source_code, const int inst_limit_c) {
+/* private static */ RegisterPack ErfiCpu::try_program
+    (const char * source_code, const int inst_limit_c)
+{
     Assembler asmr;
     MemorySpace mem;
     ErfiCpu cpu;
@@ -191,76 +448,635 @@ void try_program(const char * source_code, const int inst_limit_c) {
         asmr.assemble_from_string(source_code);
         for (UInt32 & i : *con.ram) i = 0;
         Console::load_program_to_memory(asmr.program_data(), *con.ram);
-        for (int i = 0; i != inst_limit_c; ++i)
+        for (int i = 0; i != inst_limit_c && cpu.trap() == Trap::NONE; ++i)
             con.cpu->run_cycle(con);
-    } catch (ErfiCpuError & err) {
-        auto sline = asmr.translate_to_line_number(err.program_location());
-        std::cerr << "Illegal instruction occured!\n";
-        std::cerr << "See line " << sline << " in source\n";
-        std::cerr << "Details: " << err.what() << std::endl;
+        if (cpu.trap() != Trap::NONE) {
+            auto sline = asmr.translate_to_line_number(cpu.trap_address());
+            std::cerr << "Illegal instruction occured!\n";
+            std::cerr << "See line " << sline << " in source\n";
+            std::cerr << "Details: " << cpu.trap_message() << std::endl;
+        }
     } catch (std::exception & exp) {
         std::cerr << "General exception: " << exp.what() << std::endl;
     }
+    return cpu.m_registers;
 }
 
-/* private */ void ErfiCpu::do_set(Inst inst) {
-    using Pf = SetTypeParamForm;
-    UInt32 & r0 = reg0(inst);
-    switch (decode_s_type_pf(inst)) {
-    case Pf::_2R_INTVER: r0 =        reg1              (inst) ; return;
-    case Pf::_1R_INT   : r0 = UInt32(decode_immd_as_int(inst)); return;
-    case Pf::_2R_FPVER : r0 =        reg1              (inst) ; return;
-    case Pf::_1R_FP    : r0 =        decode_immd_as_fp (inst) ; return;
+/* private static */ RegisterPack ErfiCpu::run_until_halt
+    (const char * source_code, Dispatcher dispatcher, std::size_t * executed)
+{
+    Assembler asmr;
+    MemorySpace mem;
+    ErfiCpu cpu;
+    UtilityDevices dev;
+    ConsolePack con; con.cpu = &cpu; con.ram = &mem; con.dev = &dev;
+
+    asmr.assemble_from_string(source_code);
+    for (UInt32 & i : mem) i = 0;
+    Console::load_program_to_memory(asmr.program_data(), mem);
+    cpu.set_dispatcher(dispatcher);
+    auto count = cpu.run_cycles(con, UNLIMITED_BUDGET);
+    if (executed) *executed = count;
+    assert(dev.halt_requested());
+    return cpu.m_registers;
+}
+
+/* private static */ ErfiCpu::DecodedInst ErfiCpu::decode(Inst inst) {
+    using D = DecodedOp;
+    using O = OpCode;
+    DecodedInst rv;
+    rv.r0 = UInt8(decode_reg0(inst));
+    rv.r1 = UInt8(decode_reg1(inst));
+    rv.r2 = UInt8(decode_reg2(inst));
+
+    // decoded ops for each r-type are listed in the same order as their
+    // parameter forms, type indifferent ops only have the integer forms
+    auto set_r_type = [&rv, inst](D base, bool type_indifferent) {
+        using Pf = RTypeParamForm;
+        auto pf = decode_r_type_pf(inst);
+        switch (pf) {
+        case Pf::_2R_IMMD_INT: rv.immd = UInt32(decode_immd_as_int(inst)); break;
+        case Pf::_2R_IMMD_FP : rv.immd = decode_immd_as_fp(inst); break;
+        default: break;
+        }
+        rv.op = D(int(base) + (int(pf) & (type_indifferent ? 0x1 : 0x3)));
+    };
+
+    switch (decode_op_code(inst)) {
+    case O::PLUS   : set_r_type(D::PLUS_3R       , true ); break;
+    case O::MINUS  : set_r_type(D::MINUS_3R      , true ); break;
+    case O::AND    : set_r_type(D::AND_3R        , true ); break;
+    case O::XOR    : set_r_type(D::XOR_3R        , true ); break;
+    case O::OR     : set_r_type(D::OR_3R         , true ); break;
+    case O::ROTATE : set_r_type(D::ROTATE_3R     , true ); break;
+    case O::TIMES  : set_r_type(D::TIMES_3R_INT  , false); break;
+    case O::DIVIDE : set_r_type(D::DIVIDE_3R_INT , false); break;
+    case O::MODULUS: set_r_type(D::MODULUS_3R_INT, false); break;
+    case O::COMP   : set_r_type(D::COMP_3R_INT   , false); break;
+    case O::SET:
+        switch (decode_s_type_pf(inst)) {
+        using Pf = SetTypeParamForm;
+        case Pf::_2R_INTVER: case Pf::_2R_FPVER: rv.op = D::SET_2R; break;
+        case Pf::_1R_INT:
+            rv.op   = D::SET_1R_IMMD;
+            rv.immd = UInt32(decode_immd_as_int(inst));
+            break;
+        case Pf::_1R_FP:
+            rv.op   = D::SET_1R_IMMD;
+            rv.immd = decode_immd_as_fp(inst);
+            break;
+        }
+        break;
+    case O::SAVE: case O::LOAD: {
+        bool is_save = decode_op_code(inst) == O::SAVE;
+        switch (decode_m_type_pf(inst)) {
+        using Pf = MTypeParamForm;
+        case Pf::_2R_INT:
+            rv.op   = is_save ? D::SAVE_2R_INT : D::LOAD_2R_INT;
+            rv.immd = UInt32(decode_immd_as_int(inst));
+            break;
+        case Pf::_2R: rv.op = is_save ? D::SAVE_2R : D::LOAD_2R; break;
+        case Pf::_1R_INT:
+            rv.immd = decode_immd_as_addr(inst);
+            if (rv.immd < MEMORY_WORDS)
+                rv.op = is_save ? D::SAVE_1R_RAM : D::LOAD_1R_RAM;
+            else
+                rv.op = is_save ? D::SAVE_1R_INT : D::LOAD_1R_INT;
+            break;
+        case Pf::_INVALID: // accesses address zero
+            rv.op   = is_save ? D::SAVE_1R_RAM : D::LOAD_1R_RAM;
+            break;
+        }
+        }
+        break;
+    case O::SKIP: case O::CALL: {
+        bool is_skip = decode_op_code(inst) == O::SKIP;
+        switch (decode_j_type_pf(inst)) {
+        using Pf = JTypeParamForm;
+        case Pf::_1R: rv.op = is_skip ? D::SKIP_1R : D::CALL_1R; break;
+        case Pf::_1R_INT_FOR_JUMP:
+            rv.op   = is_skip ? D::SKIP_1R_INT : D::CALL_IMMD;
+            rv.immd = UInt32(decode_immd_as_int(inst));
+            break;
+        }
+        }
+        break;
+    case O::NOT: rv.op = D::NOT; break;
+    default:
+        rv.op   = D::INVALID;
+        rv.immd = serialize(inst);
+        break;
+    }
+    return rv;
+}
+
+/* private static */ void ErfiCpu::execute
+    (UInt32 * regs, DecodedInst dinst, ConsolePack & console)
+{
+    // ------------------- This is inside a HOT LOOP --------------------------
+    using D = DecodedOp;
+#   define MACRO_SWITCH_CASE(op) \
+        case D::op: execute<D::op>(regs, dinst, console); return;
+    switch (dinst.op) {
+    MACRO_ERFI_CPU_DECODED_OP_LIST(MACRO_SWITCH_CASE)
+    case D::UNDECODED: case D::COUNT: break;
     }
+#   undef MACRO_SWITCH_CASE
+    // decoded instructions are never executed before being decoded
+    std::terminate();
 }
 
-/* private */ void ErfiCpu::do_skip(Inst inst) {
-    using Pf = JTypeParamForm;
-    UInt32 & pc = m_registers[std::size_t(Reg::PC)];
-    switch (decode_j_type_pf(inst)) {
-    case Pf::_1R             : if (reg0(inst)) ++pc; return;
-    case Pf::_1R_INT_FOR_JUMP:
-        if (reg0(inst) & UInt32(decode_immd_as_int(inst))) ++pc;
+template <ErfiCpu::DecodedOp OP>
+/* private static */ inline void ErfiCpu::execute
+    (UInt32 * regs, DecodedInst dinst, ConsolePack & console)
+{
+    using D = DecodedOp;
+    UInt32 & r0 = regs[dinst.r0];
+    const UInt32 r1 = regs[dinst.r1], r2 = regs[dinst.r2], immd = dinst.immd;
+    UInt32 & pc = regs[std::size_t(Reg::PC)];
+    // faults leave the destination untouched, pc is already past the
+    // faulting instruction
+    auto trap = [&console, &pc](Trap code)
+        { console.cpu->raise_trap(code, pc - 1); };
+    switch (OP) {
+    // R-type type indifferent
+    case D::PLUS_3R            : r0 = plus       (r1, r2  ); return;
+    case D::PLUS_2R_IMMD       : r0 = plus       (r1, immd); return;
+    case D::MINUS_3R           : r0 = minus      (r1, r2  ); return;
+    case D::MINUS_2R_IMMD      : r0 = minus      (r1, immd); return;
+    case D::AND_3R             : r0 = andi       (r1, r2  ); return;
+    case D::AND_2R_IMMD        : r0 = andi       (r1, immd); return;
+    case D::XOR_3R             : r0 = xori       (r1, r2  ); return;
+    case D::XOR_2R_IMMD        : r0 = xori       (r1, immd); return;
+    case D::OR_3R              : r0 = ori        (r1, r2  ); return;
+    case D::OR_2R_IMMD         : r0 = ori        (r1, immd); return;
+    case D::ROTATE_3R          : r0 = rotate     (r1, r2  ); return;
+    case D::ROTATE_2R_IMMD     : r0 = rotate     (r1, immd); return;
+    // R-type split by is_fp
+    case D::TIMES_3R_INT       : r0 = times      (r1, r2  ); return;
+    case D::TIMES_2R_IMMD_INT  : r0 = times      (r1, immd); return;
+    case D::TIMES_3R_FP        : r0 = fp_multiply(r1, r2  ); return;
+    case D::TIMES_2R_IMMD_FP   : r0 = fp_multiply(r1, immd); return;
+    case D::DIVIDE_3R_INT:
+        if (r2  ) r0 = div_int(r1, r2  ); else trap(Trap::DIVIDE_BY_ZERO);
+        return;
+    case D::DIVIDE_2R_IMMD_INT:
+        if (immd) r0 = div_int(r1, immd); else trap(Trap::DIVIDE_BY_ZERO);
+        return;
+    case D::DIVIDE_3R_FP:
+        if (!is_fp_zero(r2  )) r0 = div_fp(r1, r2  );
+        else trap(Trap::DIVIDE_BY_ZERO);
+        return;
+    case D::DIVIDE_2R_IMMD_FP:
+        if (!is_fp_zero(immd)) r0 = div_fp(r1, immd);
+        else trap(Trap::DIVIDE_BY_ZERO);
         return;
+    case D::MODULUS_3R_INT:
+        if (r2  ) r0 = mod_int(r1, r2  ); else trap(Trap::DIVIDE_BY_ZERO);
+        return;
+    case D::MODULUS_2R_IMMD_INT:
+        if (immd) r0 = mod_int(r1, immd); else trap(Trap::DIVIDE_BY_ZERO);
+        return;
+    case D::MODULUS_3R_FP:
+        if (!is_fp_zero(r2  )) r0 = mod_fp(r1, r2  );
+        else trap(Trap::DIVIDE_BY_ZERO);
+        return;
+    case D::MODULUS_2R_IMMD_FP:
+        if (!is_fp_zero(immd)) r0 = mod_fp(r1, immd);
+        else trap(Trap::DIVIDE_BY_ZERO);
+        return;
+    case D::COMP_3R_INT        : r0 = comp_int   (r1, r2  ); return;
+    case D::COMP_2R_IMMD_INT   : r0 = comp_int   (r1, immd); return;
+    case D::COMP_3R_FP         : r0 = fp_compare (r1, r2  ); return;
+    case D::COMP_2R_IMMD_FP    : r0 = fp_compare (r1, immd); return;
+    // M-types
+    case D::SET_2R     : r0 = r1  ; return;
+    case D::SET_1R_IMMD: r0 = immd; return;
+    case D::SAVE_2R_INT:
+        if (!write_memory(console, plus(immd, r1), r0))
+            trap(Trap::ACCESS_VIOLATION);
+        return;
+    case D::SAVE_2R:
+        if (!write_memory(console, r1, r0)) trap(Trap::ACCESS_VIOLATION);
+        return;
+    case D::SAVE_1R_INT:
+        if (!write_memory(console, immd, r0)) trap(Trap::ACCESS_VIOLATION);
+        return;
+    case D::SAVE_1R_RAM:
+        (*console.ram)[immd] = r0;
+        console.cpu->invalidate_inst_cache(immd);
+        return;
+    case D::LOAD_2R_INT:
+        if (!read_memory(console, plus(immd, r1), r0))
+            trap(Trap::ACCESS_VIOLATION);
+        return;
+    case D::LOAD_2R:
+        if (!read_memory(console, r1, r0)) trap(Trap::ACCESS_VIOLATION);
+        return;
+    case D::LOAD_1R_INT:
+        if (!read_memory(console, immd, r0)) trap(Trap::ACCESS_VIOLATION);
+        return;
+    case D::LOAD_1R_RAM: r0 = (*console.ram)[immd]; return;
+    // J-types
+    case D::SKIP_1R    : if (r0         ) ++pc; return;
+    case D::SKIP_1R_INT: if (r0 & immd  ) ++pc; return;
+    case D::CALL_1R: case D::CALL_IMMD:
+        if (!write_memory(console, ++regs[std::size_t(Reg::SP)], pc)) {
+            trap(Trap::ACCESS_VIOLATION);
+            return;
+        }
+        // r0 is read after the push, in case it is the stack pointer
+        pc = (OP == D::CALL_1R) ? r0 : immd;
+        return;
+    // "O"-types
+    case D::NOT: r0 = ~r1; return;
+    case D::INVALID:
+        console.cpu->raise_trap(Trap::ILLEGAL_INSTRUCTION, pc - 1, immd);
+        return;
+    // superinstructions, pc already points past the whole sequence
+    case D::COMP_SKIP_JUMP_3R_INT:
+        r0 = comp_int(r1, r2);
+        if (!(r0 & dinst.mask)) pc = dinst.extra;
+        return;
+    case D::COMP_SKIP_JUMP_2R_IMMD_INT:
+        r0 = comp_int(r1, immd);
+        if (!(r0 & dinst.mask)) pc = dinst.extra;
+        return;
+    case D::COMP_SKIP_JUMP_3R_FP:
+        r0 = fp_compare(r1, r2);
+        if (!(r0 & dinst.mask)) pc = dinst.extra;
+        return;
+    case D::COMP_SKIP_JUMP_2R_IMMD_FP:
+        r0 = fp_compare(r1, immd);
+        if (!(r0 & dinst.mask)) pc = dinst.extra;
+        return;
+    case D::SKIP_JUMP: if (!(r0 & immd)) pc = dinst.extra; return;
+    case D::PUSH: {
+        const int count = dinst.length - 1;
+        const UInt32 start = pc - dinst.length;
+        UInt32 & sp = regs[std::size_t(Reg::SP)];
+        for (int i = 0; i != count; ++i) {
+            if (!write_memory(console, plus(sp, UInt32(i + 1)),
+                              regs[(dinst.extra >> (i*4)) & 0xF]))
+            {
+                console.cpu->raise_trap
+                    (Trap::ACCESS_VIOLATION, start + UInt32(i));
+            }
+            // a stop, trap or a write over translated code, leaves the rest
+            // of the push to the individual instructions
+            if (!console.dev->no_stop_signal() ||
+                console.cpu->m_leave_block)
+            {
+                pc = start + UInt32(i + 1);
+                return;
+            }
+        }
+        sp += UInt32(count);
+        }
+        return;
+    case D::POP: case D::POP_RETURN: {
+        const int count = dinst.length - 1;
+        UInt32 & sp = regs[std::size_t(Reg::SP)];
+        sp -= UInt32(count);
+        for (int i = 0; i != count; ++i) {
+            if (read_memory(console, plus(sp, UInt32(count - i)),
+                            regs[(dinst.extra >> (i*4)) & 0xF]))
+            { continue; }
+            // as if each load was executed on its own
+            const UInt32 load_address = pc - dinst.length + UInt32(i + 1);
+            pc = load_address + 1;
+            console.cpu->raise_trap(Trap::ACCESS_VIOLATION, load_address);
+            return;
+        }
+        }
+        return;
+    case D::END_BLOCK: return;
+    case D::UNDECODED: case D::COUNT: break;
+    }
+    std::terminate();
+}
+
+/* private */ void ErfiCpu::step(UInt32 * regs, ConsolePack & console) {
+    auto & pc_reg = regs[std::size_t(Reg::PC)];
+    if (pc_reg >= console.ram->size())
+        return raise_trap(Trap::INVALID_PC, pc_reg);
+    // decoding is only done the first time an address is executed, or the
+    // first time since that address was written to
+    DecodedInst & dinst = m_inst_cache[pc_reg];
+    if (dinst.op == DecodedOp::UNDECODED)
+        dinst = decode(deserialize((*console.ram)[pc_reg]));
+    ++pc_reg;
+    execute(regs, dinst, console);
+}
+
+/* private */ std::size_t ErfiCpu::run_switched
+    (UInt32 * regs, ConsolePack & console, std::size_t budget)
+{
+    std::size_t executed = 0;
+    for (; executed != budget && console.dev->no_stop_signal(); ++executed) {
+        step(regs, console);
+        if (m_trap != Trap::NONE) break;
     }
+    return executed;
 }
 
-/* private */ void ErfiCpu::do_call(Inst inst, ConsolePack & pack) {
-    using Pf = JTypeParamForm;
-    UInt32 & pc = m_registers[std::size_t(Reg::PC)];
-    do_write(pack, ++m_registers[std::size_t(Reg::SP)], pc);
-    switch (decode_j_type_pf(inst)) {
-    case Pf::_1R           : pc = reg0(inst); return;
-    case Pf::_IMMD_FOR_CALL: pc = UInt32(decode_immd_as_int(inst)); return;
+#ifdef MACRO_HAS_COMPUTED_GOTO
+#   pragma GCC diagnostic push
+// labels as values are a GCC extension (also supported by Clang)
+#   pragma GCC diagnostic ignored "-Wpedantic"
+#endif
+
+/* private */ std::size_t ErfiCpu::run_threaded
+    (UInt32 * regs, ConsolePack & console, const std::size_t budget)
+{
+    // ------------------- This is inside a HOT LOOP --------------------------
+    // pc is only bounds checked when entering a block, within a block it is
+    // only advanced by each instruction's length
+    // the remaining budget is only checked when entering a block, which
+    // cannot be overrun while it covers the longest possible block
+    using D = DecodedOp;
+    UInt32 & pc = regs[std::size_t(Reg::PC)];
+    const MemorySpace & ram = *console.ram;
+    const UtilityDevices & dev = *console.dev;
+    const DecodedInst * ip;
+    DecodedInst dinst;
+    std::size_t remaining = budget;
+    // address just past the running instruction, all of its words are taken
+    // from the budget up front, so a push left part way gives back the words
+    // it did not run (they are run, and counted, one at a time afterward)
+    UInt32 inst_end = 0;
+
+    if (!dev.no_stop_signal()) return 0;
+#   ifdef MACRO_HAS_COMPUTED_GOTO
+#   define MACRO_LABEL_ADDRESS(op) &&handle_##op,
+    static void * const handlers[] = {
+        &&handle_UNDECODED,
+        MACRO_ERFI_CPU_DECODED_OP_LIST(MACRO_LABEL_ADDRESS)
+    };
+#   undef MACRO_LABEL_ADDRESS
+    static_assert(sizeof(handlers)/sizeof(handlers[0]) == std::size_t(D::COUNT),
+                  "Every decoded op requires a handler.");
+
+#   define MACRO_DISPATCH() \
+        dinst = *ip; \
+        pc += dinst.length; \
+        remaining -= dinst.length; \
+        goto *handlers[std::size_t(dinst.op)]
+
+    next_block:
+        if (remaining < MAX_BLOCK_LENGTH) goto finish_budget;
+        if (pc >= MEMORY_WORDS) {
+            raise_trap(Trap::INVALID_PC, pc);
+            return budget - remaining;
+        }
+        ip = block_at(pc, ram);
+        MACRO_DISPATCH();
+
+    leave_block:
+        // the word raising a trap is not counted, nor anything after it (the
+        // words of a fused push or pop before it have run)
+        if (m_trap != Trap::NONE)
+            return budget - remaining - (inst_end - m_trap_address);
+        goto next_block;
+
+#   define MACRO_HANDLER(op) \
+        handle_##op: \
+        inst_end = pc; \
+        execute<D::op>(regs, dinst, console); \
+        if (D::op == D::PUSH && m_trap == Trap::NONE) \
+            remaining += inst_end - pc; \
+        if (writes_memory(D::op) && !dev.no_stop_signal()) \
+            return budget - remaining; \
+        if ((writes_memory(D::op) || may_trap(D::op)) && m_leave_block) \
+            goto leave_block; \
+        if (is_fused_branch(D::op)) \
+            remaining += skipped_jump(regs, dinst) ? 1 : 0; \
+        if (ends_block(D::op)) goto next_block; \
+        ++ip; \
+        MACRO_DISPATCH();
+    MACRO_ERFI_CPU_DECODED_OP_LIST(MACRO_HANDLER)
+#   undef MACRO_HANDLER
+#   undef MACRO_DISPATCH
+
+    handle_UNDECODED:
+        // blocks only contain decoded instructions
+        std::terminate();
+#   else
+    // portable fallback, one indirect call per instruction
+#   define MACRO_HANDLER_ADDRESS(op) &ErfiCpu::execute<D::op>,
+    static const Handler handlers[] = {
+        nullptr,
+        MACRO_ERFI_CPU_DECODED_OP_LIST(MACRO_HANDLER_ADDRESS)
+    };
+#   undef MACRO_HANDLER_ADDRESS
+    static_assert(sizeof(handlers)/sizeof(handlers[0]) == std::size_t(D::COUNT),
+                  "Every decoded op requires a handler.");
+    while (remaining >= MAX_BLOCK_LENGTH) {
+        if (pc >= MEMORY_WORDS) {
+            raise_trap(Trap::INVALID_PC, pc);
+            return budget - remaining;
+        }
+        ip = block_at(pc, ram);
+        for (;; ++ip) {
+            dinst = *ip;
+            pc += dinst.length;
+            remaining -= dinst.length;
+            inst_end = pc;
+            handlers[std::size_t(dinst.op)](regs, dinst, console);
+            if (dinst.op == D::PUSH && m_trap == Trap::NONE)
+                remaining += inst_end - pc;
+            if (is_fused_branch(dinst.op) && skipped_jump(regs, dinst))
+                ++remaining;
+            if (ends_block(dinst.op)) break;
+            if ((writes_memory(dinst.op) || may_trap(dinst.op)) &&
+                (!dev.no_stop_signal() || m_leave_block))
+            { break; }
+        }
+        // the word raising a trap is not counted, nor anything after it
+        if (m_trap != Trap::NONE)
+            return budget - remaining - (inst_end - m_trap_address);
+        if (!dev.no_stop_signal()) return budget - remaining;
     }
+#   endif
+    // what is left of the budget is spent one word at a time
+#   ifdef MACRO_HAS_COMPUTED_GOTO
+    finish_budget:
+#   endif
+    remaining -= run_switched(regs, console, remaining);
+    return budget - remaining;
 }
 
-/* private */ void ErfiCpu::do_not(Inst inst) {
-    // prevent from accidently mutating register one
-    UInt32 t   = reg1(inst);
-    reg0(inst) = ~t;
+#ifdef MACRO_HAS_COMPUTED_GOTO
+#   pragma GCC diagnostic pop
+#endif
+
+/* private */ const ErfiCpu::DecodedInst * ErfiCpu::block_at
+    (UInt32 pc, const MemorySpace & ram)
+{
+    m_leave_block = false;
+    UInt32 index = m_block_index[pc];
+    if (index == 0)
+        index = translate_block(pc, ram);
+    return &m_block_insts[index];
 }
 
-/* private */ UInt32 ErfiCpu::get_move_op_address(Inst inst) {
-    using Pf = MTypeParamForm;
-    switch (decode_m_type_pf(inst)) {
-    case Pf::_2R_INT : return plus(UInt32(decode_immd_as_int(inst)), reg1(inst));
-    case Pf::_2R     : return reg1(inst);
-    case Pf::_1R_INT : return decode_immd_as_addr(inst);
-    case Pf::_INVALID: return 0;
+/* private */ UInt32 ErfiCpu::translate_block
+    (UInt32 pc, const MemorySpace & ram)
+{
+    using D = DecodedOp;
+    // instructions which write to any register but the pc, may continue
+    // the block
+    auto writes_pc = [](const DecodedInst & dinst) {
+        switch (dinst.op) {
+        case D::SAVE_2R_INT: case D::SAVE_2R: case D::SAVE_1R_INT:
+        case D::SAVE_1R_RAM: case D::PUSH: return false;
+        default: return dinst.r0 == UInt8(Reg::PC);
+        }
+    };
+    // device writes through an immediate address (e.g. "io wait"/"io halt")
+    // usually stop the CPU, and are often the last instruction before data
+    auto saves_to_device = [](const DecodedInst & dinst) {
+        return dinst.op == D::SAVE_1R_INT &&
+               (dinst.immd & device_addresses::DEVICE_ADDRESS_MASK);
+    };
+
+    const UInt32 index = UInt32(m_block_insts.size());
+    UInt32 address = pc;
+    while (address < MEMORY_WORDS && address - pc < MAX_BLOCK_LENGTH) {
+        DecodedInst dinst = fuse_instructions(address, ram);
+        m_block_insts.push_back(dinst);
+        for (UInt32 i = 0; i != dinst.length; ++i)
+            m_block_coverage[address + i] = 1;
+        address += dinst.length;
+        if (ends_block(dinst.op) || dinst.op == D::INVALID ||
+            writes_pc(dinst) || saves_to_device(dinst))
+        { break; }
     }
-    std::terminate();
+    DecodedInst end_block;
+    end_block.op     = D::END_BLOCK;
+    end_block.length = 0;
+    m_block_insts.push_back(end_block);
+    m_block_index[pc] = index;
+    return index;
 }
 
-/* private */ [[noreturn]] void ErfiCpu::throw_error(Inst i) const {
-    //               PC increment while the instruction is executing
-    //               so it will be one too great if an illegal instruction
-    //               is encountered -> what about jumps?
-    throw ErfiCpuError(m_registers[std::size_t(Reg::PC)] - 1,
-                       std::move(disassemble_instruction(i)));
+/* private static */ ErfiCpu::DecodedInst ErfiCpu::fuse_instructions
+    (UInt32 address, const MemorySpace & ram)
+{
+    using D = DecodedOp;
+    static constexpr const UInt8 SP = UInt8(Reg::SP);
+    static constexpr const UInt8 PC = UInt8(Reg::PC);
+
+    auto decode_at = [&ram](UInt32 addr) {
+        if (addr >= MEMORY_WORDS) return DecodedInst();
+        return decode(deserialize(ram[addr]));
+    };
+    // "jump label"
+    auto is_immd_jump = [](const DecodedInst & dinst)
+        { return dinst.op == D::SET_1R_IMMD && dinst.r0 == PC; };
+    auto is_skip = [](const DecodedInst & dinst)
+        { return dinst.op == D::SKIP_1R || dinst.op == D::SKIP_1R_INT; };
+    auto skip_mask = [](const DecodedInst & skip)
+        { return skip.op == D::SKIP_1R ? ~UInt32(0) : skip.immd; };
+
+    const DecodedInst first = decode_at(address);
+    DecodedInst rv = first;
+
+    // superinstructions must not read the pc, as it is only updated once
+    // for the whole sequence
+    switch (first.op) {
+    case D::COMP_3R_INT: case D::COMP_3R_FP:
+        if (first.r2 == PC) break;
+        MACRO_FALLTHROUGH;
+    case D::COMP_2R_IMMD_INT: case D::COMP_2R_IMMD_FP: {
+        // comp a x y; skip a [mask]; jump label
+        const DecodedInst skip = decode_at(address + 1);
+        const DecodedInst jump = decode_at(address + 2);
+        if (first.r0 == PC || first.r1 == PC || !is_skip(skip) ||
+            skip.r0 != first.r0 || !is_immd_jump(jump))
+        { break; }
+        rv.op = D(int(D::COMP_SKIP_JUMP_3R_INT) +
+                  (int(first.op) - int(D::COMP_3R_INT)));
+        // comparisons only ever set the lowest four bits
+        rv.mask   = UInt8(skip_mask(skip) & 0xFF);
+        rv.extra  = jump.immd;
+        rv.length = 3;
+        }
+        break;
+    case D::SKIP_1R: case D::SKIP_1R_INT: {
+        // skip r [mask]; jump label
+        const DecodedInst jump = decode_at(address + 1);
+        if (first.r0 == PC || !is_immd_jump(jump)) break;
+        rv.op     = D::SKIP_JUMP;
+        rv.immd   = skip_mask(first);
+        rv.extra  = jump.immd;
+        rv.length = 2;
+        }
+        break;
+    case D::SAVE_2R_INT: {
+        // push r_1 ... r_n := save r_k [sp + k] ...; add sp sp n
+        int count = 0;
+        UInt32 regs = 0;
+        DecodedInst next = first;
+        while (next.op == D::SAVE_2R_INT && next.r1 == SP && next.r0 != PC &&
+               next.immd == UInt32(count + 1) && count != MAX_FUSED_STACK_OP)
+        {
+            regs |= UInt32(next.r0) << (count*4);
+            next = decode_at(address + UInt32(++count));
+        }
+        if (next.op != D::PLUS_2R_IMMD || next.r0 != SP || next.r1 != SP ||
+            next.immd != UInt32(count))
+        { break; }
+        rv = DecodedInst();
+        rv.op     = D::PUSH;
+        rv.extra  = regs;
+        rv.length = UInt8(count + 1);
+        }
+        break;
+    case D::MINUS_2R_IMMD: {
+        // pop r_1 ... r_n := sub sp sp n; load r_k [sp + n + 1 - k] ...
+        const int count = int(first.immd);
+        if (first.r0 != SP || first.r1 != SP || count < 1 ||
+            count > MAX_FUSED_STACK_OP)
+        { break; }
+        UInt32 regs = 0;
+        bool returns = false;
+        for (int i = 0; i != count; ++i) {
+            auto load = decode_at(address + UInt32(i) + 1);
+            if (load.op != D::LOAD_2R_INT || load.r1 != SP ||
+                load.immd != UInt32(count - i))
+            { return first; }
+            regs |= UInt32(load.r0) << (i*4);
+            returns = returns || load.r0 == PC;
+        }
+        rv = DecodedInst();
+        rv.op     = returns ? D::POP_RETURN : D::POP;
+        rv.extra  = regs;
+        rv.length = UInt8(count + 1);
+        }
+        break;
+    default: break;
+    }
+    return rv;
+}
+
+/* private */ void ErfiCpu::raise_trap
+    (Trap trap, UInt32 address, UInt32 detail)
+{
+    m_trap         = trap;
+    m_trap_address = address;
+    m_trap_detail  = detail;
+    m_leave_block  = true;
+}
+
+/* private */ void ErfiCpu::flush_blocks() {
+    m_block_insts.resize(1);
+    std::fill(m_block_index.begin(), m_block_index.end(), 0);
+    std::fill(m_block_coverage.begin(), m_block_coverage.end(), 0);
+    m_leave_block = true;
 }
 
-/* private */ std::string ErfiCpu::disassemble_instruction(Inst i) const {
+/* private static */ std::string ErfiCpu::disassemble_instruction(Inst i) {
     return std::string("Unsupport instruction \"") +
            op_code_to_string(i) + "\" with parameter form of: " +
            param_form_to_string(i);
@@ -282,15 +1098,15 @@ UInt32 rotate(UInt32 x, UInt32 y) {
     return x;
 }
 
+bool is_fp_zero(UInt32 x) { return (x & 0x7FFFFFFF) == 0; }
+
 UInt32 div_fp  (UInt32 x, UInt32 y) {
-    static const auto FP_ZERO_ = erfin::to_fixed_point(0.0);
-    if (y == FP_ZERO_)
-        throw Error("Attempted to divide by zero.");
+    assert(!is_fp_zero(y));
     return erfin::fp_divide(x, y);
 }
 
 UInt32 div_int (UInt32 x, UInt32 y) {
-    if (y == 0u) throw Error("Attempted to divide by zero.");
+    assert(y != 0u);
     return UInt32(erfin::Int32(x) / erfin::Int32(y));
 }
 
@@ -299,7 +1115,7 @@ UInt32 mod_fp  (UInt32 x, UInt32 y) {
 }
 
 UInt32 mod_int (UInt32 x, UInt32 y) {
-    if (y == 0) throw Error("Attempted to divide by zero.");
+    assert(y != 0u);
     static const auto sign = [](UInt32 x) { return x & 0x80000000; };
     static const auto mag  = [](UInt32 x) { return sign(x) ? ~(x - 1) : x; };
     // the C++ standard does not specify how negatives are moded
@@ -318,6 +1134,36 @@ UInt32 comp_int(UInt32 x, UInt32 y) {
     return temp;
 }
 
+inline bool read_memory
+    (erfin::ConsolePack & con, UInt32 address, UInt32 & out)
+{
+    using namespace erfin::device_addresses;
+    if (address < MEMORY_WORDS) {
+        out = (*con.ram)[address];
+        return true;
+    } else if (address & DEVICE_ADDRESS_MASK) {
+        out = erfin::do_read(con, address);
+        return true;
+    }
+    return false;
+}
+
+inline bool write_memory
+    (erfin::ConsolePack & con, UInt32 address, UInt32 data)
+{
+    using namespace erfin::device_addresses;
+    if (address < MEMORY_WORDS) {
+        (*con.ram)[address] = data;
+        // program may be modifying itself
+        con.cpu->invalidate_inst_cache(address);
+        return true;
+    } else if (address & DEVICE_ADDRESS_MASK) {
+        erfin::do_write(con, address, data);
+        return true;
+    }
+    return false;
+}
+
 const char * op_code_to_string(erfin::Inst i) {
     using namespace erfin;
     using O = OpCode;
@@ -28,6 +28,8 @@
 
 #include <iosfwd>
 #include <random>
+#include <vector>
+#include <limits>
 
 namespace erfin {
 
@@ -35,8 +37,41 @@ class Debugger;
 
 class ErfiCpu {
 public:
+    /** How decoded instructions are dispatched to their handlers.
+     *  - SWITCH  : one switch statement per executed instruction
+     *  - THREADED: memory is translated into basic blocks, with common
+     *              instruction sequences fused into superinstructions, each
+     *              handler jumps directly to the next handler in the block
+     *              (computed goto on GCC/Clang, a function pointer table on
+     *              other compilers)
+     */
+    enum class Dispatcher { SWITCH, THREADED };
+
+    static constexpr const std::size_t UNLIMITED_BUDGET =
+        std::numeric_limits<std::size_t>::max();
+
+    static constexpr const Dispatcher DEFAULT_DISPATCHER =
+#   ifdef MACRO_USE_SWITCH_DISPATCHER
+        Dispatcher::SWITCH;
+#   else
+        Dispatcher::THREADED;
+#   endif
+
+    /** Faults raised by an instruction. Rather than throwing from the
+     *  middle of execution, the CPU records the trap and stops, it is then
+     *  up to the caller to report it (see Console).
+     */
+    enum class Trap : UInt8 {
+        NONE,
+        ILLEGAL_INSTRUCTION,
+        INVALID_PC,
+        ACCESS_VIOLATION,
+        DIVIDE_BY_ZERO
+    };
+
     ErfiCpu();
 
+    /** Clears the registers and any pending trap. */
     void reset();
 
     void do_nothing(MemorySpace &, ConsolePack *){}
@@ -45,54 +80,215 @@ public:
 
     void run_cycle(Inst inst, ConsolePack & console);
 
+    /** Executes at most budget instructions, returning early only when the
+     *  console's stop signal is raised (a wait or halt request) or a trap is
+     *  raised. The register file is kept local to the call, so the debugger
+     *  sees the registers as of the last instruction executed.
+     *  @return number of instructions executed (not counting one which
+     *          raised a trap), zero if the stop signal was already raised or
+     *          a trap is pending
+     */
+    std::size_t run_cycles(ConsolePack & console, std::size_t budget);
+
+    Trap trap() const { return m_trap; }
+
+    /** @returns address of the instruction which raised the pending trap */
+    UInt32 trap_address() const { return m_trap_address; }
+
+    /** @returns description of the pending trap for error reporting */
+    std::string trap_message() const;
+
+    void set_dispatcher(Dispatcher dispatcher) { m_dispatcher = dispatcher; }
+
+    /** Drops the pre-decoded form of the instruction at the given address
+     *  (and any translated block covering it), must be called whenever that
+     *  word of memory is written to.
+     */
+    void invalidate_inst_cache(UInt32 address);
+
+    /** Drops every pre-decoded instruction and translated block (e.g. when
+     *  a new program is loaded into memory).
+     */
+    void clear_inst_cache();
+
     void update_debugger(Debugger & dbgr) const;
 
     static void run_tests();
 
 private:
-    UInt32 & reg0(Inst inst);
-    UInt32 & reg1(Inst inst);
-    UInt32 & reg2(Inst inst);
+    // Every (op code, parameter form) pair that the CPU can execute, fp and
+    // integer forms are merged where the operation is type indifferent.
+    // Each has its own handler, so this list is used to build the enum
+    // and every dispatcher's jump table in the same order.
+#   define MACRO_ERFI_CPU_DECODED_OP_LIST(F) \
+        F(PLUS_3R       ) F(PLUS_2R_IMMD       )                           \
+        F(MINUS_3R      ) F(MINUS_2R_IMMD      )                           \
+        F(AND_3R        ) F(AND_2R_IMMD        )                           \
+        F(XOR_3R        ) F(XOR_2R_IMMD        )                           \
+        F(OR_3R         ) F(OR_2R_IMMD         )                           \
+        F(ROTATE_3R     ) F(ROTATE_2R_IMMD     )                           \
+        F(TIMES_3R_INT  ) F(TIMES_2R_IMMD_INT  )                           \
+        F(TIMES_3R_FP   ) F(TIMES_2R_IMMD_FP   )                           \
+        F(DIVIDE_3R_INT ) F(DIVIDE_2R_IMMD_INT )                           \
+        F(DIVIDE_3R_FP  ) F(DIVIDE_2R_IMMD_FP  )                           \
+        F(MODULUS_3R_INT) F(MODULUS_2R_IMMD_INT)                           \
+        F(MODULUS_3R_FP ) F(MODULUS_2R_IMMD_FP )                           \
+        F(COMP_3R_INT   ) F(COMP_2R_IMMD_INT   )                           \
+        F(COMP_3R_FP    ) F(COMP_2R_IMMD_FP    )                           \
+        F(SET_2R        ) F(SET_1R_IMMD        )                           \
+        F(SAVE_2R_INT   ) F(SAVE_2R            ) F(SAVE_1R_INT)            \
+        F(LOAD_2R_INT   ) F(LOAD_2R            ) F(LOAD_1R_INT)            \
+        /* immediate addresses known to be in RAM */                       \
+        F(SAVE_1R_RAM   ) F(LOAD_1R_RAM        )                           \
+        F(SKIP_1R       ) F(SKIP_1R_INT        )                           \
+        F(CALL_1R       ) F(CALL_IMMD          )                           \
+        F(NOT           )                                                  \
+        F(INVALID       ) /* immediate holds the whole instruction */      \
+        /* superinstructions, these only appear in translated blocks */    \
+        F(COMP_SKIP_JUMP_3R_INT) F(COMP_SKIP_JUMP_2R_IMMD_INT)             \
+        F(COMP_SKIP_JUMP_3R_FP ) F(COMP_SKIP_JUMP_2R_IMMD_FP )             \
+        F(SKIP_JUMP     )                                                  \
+        F(PUSH          ) F(POP                ) F(POP_RETURN )            \
+        F(END_BLOCK     ) /* continue with the block at pc */
+#   define MACRO_ERFI_CPU_ENUM_ENTRY(op) op,
+    enum class DecodedOp : UInt8 {
+        UNDECODED, // must be zero, not yet decoded
+        MACRO_ERFI_CPU_DECODED_OP_LIST(MACRO_ERFI_CPU_ENUM_ENTRY)
+        COUNT
+    };
+#   undef MACRO_ERFI_CPU_ENUM_ENTRY
 
-    template <UInt32(*FuncFp)(UInt32, UInt32), UInt32(*FuncInt)(UInt32, UInt32)>
-    void do_arth(Inst inst);
-    void do_set(Inst inst);
+    // One per word of memory, the immediate is already expanded to its
+    // final 32bit form (integer, fixed point or address).
+    // Superinstructions span several words, and keep the jump target or
+    // packed register list (4 bits per register) in "extra".
+    struct DecodedInst {
+        DecodedInst():
+            op(DecodedOp::UNDECODED), r0(0), r1(0), r2(0), length(1),
+            mask(0), immd(0), extra(0)
+        {}
+        DecodedOp op;
+        UInt8 r0, r1, r2;
+        UInt8 length; // number of words of memory executed
+        UInt8 mask;   // skip mask of a fused comparison
+        UInt32 immd;
+        UInt32 extra;
+    };
 
-    void do_skip(Inst inst);
-    void do_call(Inst inst, ConsolePack & pack);
+    // blocks never grow beyond this many words of memory
+    static constexpr const UInt32 MAX_BLOCK_LENGTH = 64;
+    // longest push/pop that may be fused
+    static constexpr const int MAX_FUSED_STACK_OP = 8;
 
-    void do_not(Inst inst);
+    using Handler = void(*)(UInt32 *, DecodedInst, ConsolePack &);
 
-    UInt32 get_move_op_address(Inst inst);
+    static DecodedInst decode(Inst inst);
 
-    [[noreturn]] void throw_error(Inst i) const;
+    static void execute(UInt32 * regs, DecodedInst dinst, ConsolePack & console);
 
-    std::string disassemble_instruction(Inst i) const;
+    template <DecodedOp OP>
+    static void execute(UInt32 * regs, DecodedInst dinst, ConsolePack & console);
+
+    // superinstructions ending with a skip over a jump
+    static constexpr bool is_fused_branch(DecodedOp op) {
+        return op == DecodedOp::SKIP_JUMP ||
+               (op >= DecodedOp::COMP_SKIP_JUMP_3R_INT &&
+                op <= DecodedOp::COMP_SKIP_JUMP_2R_IMMD_FP);
+    }
+
+    // ops which may leave the current block
+    static constexpr bool ends_block(DecodedOp op) {
+        return op == DecodedOp::SKIP_1R || op == DecodedOp::SKIP_1R_INT ||
+               op == DecodedOp::CALL_1R || op == DecodedOp::CALL_IMMD   ||
+               op == DecodedOp::POP_RETURN || op == DecodedOp::END_BLOCK ||
+               is_fused_branch(op);
+    }
+
+    // a fused branch which skipped its jump has executed one instruction
+    // less than its length
+    static bool skipped_jump(const UInt32 * regs, const DecodedInst & dinst) {
+        return (regs[dinst.r0] &
+                (dinst.op == DecodedOp::SKIP_JUMP ? dinst.immd : dinst.mask))
+               != 0;
+    }
+
+    // ops which can raise a trap
+    static constexpr bool may_trap(DecodedOp op) {
+        return (op >= DecodedOp::DIVIDE_3R_INT &&
+                op <= DecodedOp::MODULUS_2R_IMMD_FP) ||
+               (op >= DecodedOp::SAVE_2R_INT && op <= DecodedOp::LOAD_1R_INT) ||
+               op == DecodedOp::CALL_1R || op == DecodedOp::CALL_IMMD ||
+               op == DecodedOp::INVALID || op == DecodedOp::PUSH      ||
+               op == DecodedOp::POP     || op == DecodedOp::POP_RETURN;
+    }
+
+    // only writes may touch the devices which raise the stop signal, or
+    // modify memory which has been translated
+    static constexpr bool writes_memory(DecodedOp op) {
+        return op == DecodedOp::SAVE_2R_INT || op == DecodedOp::SAVE_2R     ||
+               op == DecodedOp::SAVE_1R_INT || op == DecodedOp::SAVE_1R_RAM ||
+               op == DecodedOp::CALL_1R     || op == DecodedOp::CALL_IMMD   ||
+               op == DecodedOp::PUSH;
+    }
+
+    // executes the instruction at pc, one word at a time
+    void step(UInt32 * regs, ConsolePack & console);
+
+    std::size_t run_switched
+        (UInt32 * regs, ConsolePack & console, std::size_t budget);
+    std::size_t run_threaded
+        (UInt32 * regs, ConsolePack & console, std::size_t budget);
+
+    // returns the first instruction of the block starting at pc, which is
+    // translated if needed (pc must be a valid address)
+    const DecodedInst * block_at(UInt32 pc, const MemorySpace & ram);
+
+    UInt32 translate_block(UInt32 pc, const MemorySpace & ram);
+
+    static DecodedInst fuse_instructions
+        (UInt32 address, const MemorySpace & ram);
+
+    void flush_blocks();
+
+    // records the trap, the running block must not continue
+    void raise_trap(Trap trap, UInt32 address, UInt32 detail = 0);
+
+    static RegisterPack try_program(const char * source_code, int inst_limit);
+
+    // executed, if given, receives the number of instructions run
+    static RegisterPack run_until_halt
+        (const char * source_code, Dispatcher dispatcher,
+         std::size_t * executed = nullptr);
+
+    static std::string disassemble_instruction(Inst i);
 
     RegisterPack m_registers;
+    std::vector<DecodedInst> m_inst_cache;
+    Dispatcher m_dispatcher;
+
+    // translated blocks, index zero is never a block
+    std::vector<DecodedInst> m_block_insts;
+    // per word of memory: index of the block starting there
+    std::vector<UInt32> m_block_index;
+    // per word of memory: non zero if any block includes that word
+    std::vector<UInt8> m_block_coverage;
+    // set when translated blocks are dropped or a trap is raised, the
+    // running block must not continue
+    bool m_leave_block;
+
+    Trap m_trap;
+    UInt32 m_trap_address;
+    // the offending instruction of an illegal instruction trap
+    UInt32 m_trap_detail;
 };
 
 // -------------------------- Implemenation Detail ----------------------------
 
-template <UInt32(*FuncFp)(UInt32, UInt32), UInt32(*FuncInt)(UInt32, UInt32)>
-/* private */ void ErfiCpu::do_arth(Inst inst) {
-    using Pf = RTypeParamForm;
-    UInt32 & r0 = reg0(inst), & r1 = reg1(inst);
-    switch (decode_r_type_pf(inst)) {
-    case Pf::_3R_INT     : r0 = FuncInt(r1, reg2(inst)              ); return;
-    case Pf::_2R_IMMD_INT: r0 = FuncInt(r1, decode_immd_as_int(inst)); return;
-    case Pf::_3R_FP      : r0 = FuncFp (r1, reg2(inst)              ); return;
-    case Pf::_2R_IMMD_FP : r0 = FuncFp (r1, decode_immd_as_fp (inst)); return;
-    }
+inline void ErfiCpu::invalidate_inst_cache(UInt32 address) {
+    m_inst_cache[address] = DecodedInst();
+    if (m_block_coverage[address]) flush_blocks();
 }
 
-/* private */ inline UInt32 & ErfiCpu::reg0(Inst inst)
-    { return m_registers.data()[std::size_t(decode_reg0(inst))]; }
-/* private */ inline UInt32 & ErfiCpu::reg1(Inst inst)
-    { return m_registers.data()[std::size_t(decode_reg1(inst))]; }
-/* private */ inline UInt32 & ErfiCpu::reg2(Inst inst)
-    { return m_registers.data()[std::size_t(decode_reg2(inst))]; }
-
 } // end of erfin namespace
 
 #endif
@@ -297,7 +297,8 @@ Inst encode(OpCode op, Reg r0, Reg r1, Immd i) {
 bool is_valid_value(const ApuInstructionType it) {
     using Ait = ApuInstructionType;
     switch (it) {
-    case Ait::NOTE: case Ait::TEMPO: case Ait::DUTY_CYCLE_WINDOW: return true;
+    case Ait::NOTE: case Ait::TEMPO: case Ait::DUTY_CYCLE_WINDOW:
+    case Ait::NOISE_MODE: return true;
     default: return false;
     }
 }
@@ -320,12 +321,21 @@ bool is_valid_value(DutyCycleOption it) {
     }
 }
 
+bool is_valid_value(NoiseMode mode) {
+    switch (mode) {
+    case NoiseMode::LONG_PERIOD: case NoiseMode::SHORT_PERIOD: return true;
+    default: return false;
+    }
+}
+
 // ---------------------- GPU Constants/utility functions ---------------------
 
 bool is_valid_gpu_op_code(GpuOpCode code) noexcept {
     using namespace gpu_enum_types;
     switch (code) {
-    case UPLOAD: case DRAW: case CLEAR: return true;
+    case UPLOAD: case DRAW: case CLEAR: case DRAW_LIST: case TILE_MAP:
+    case TILE_SCROLL:
+        return true;
     }
     return false;
 }
@@ -333,9 +343,12 @@ bool is_valid_gpu_op_code(GpuOpCode code) noexcept {
 int parameters_per_instruction(GpuOpCode code) {
     using namespace gpu_enum_types;
     switch (code) {
-    case UPLOAD: return 4;
-    case DRAW  : return 3;
-    case CLEAR : return 0;
+    case UPLOAD     : return 4;
+    case DRAW       : return 3;
+    case CLEAR      : return 0;
+    case DRAW_LIST  : return 2;
+    case TILE_MAP   : return 3;
+    case TILE_SCROLL: return 2;
     }
     throw Error("Invalid gpu instruction code provided... Malformed gpu "
                 "command perhaps?"                                       );
@@ -100,6 +100,26 @@ DRAW_SPRITE
 SCREEN_CLEAR
  - takes no parameters
 
+DRAW_LIST
+ - parameters: address, count
+ - draws count sprites from (x pos, y pos, index for sprite) records packed
+   in memory starting at address
+
+TILE_MAP
+ - parameters: address, width, height
+ - sets the background layer, a width by height map of 8x8 tiles stored
+   row by row at address, each a mini sprite index (any other value is a
+   blank tile). Every SCREEN_CLEAR then fills the screen with the map
+   rather than blanking it. A width or height of zero turns the layer off.
+
+TILE_SCROLL
+ - parameters: x, y
+ - pixel of the map shown at the top left of the screen (signed, the map
+   repeats in every direction)
+
+The command stream holds up to 65536 words per frame, a write to a full
+stream is dropped and sets the bus error.
+
 ### APU (Addresses 0x0000 0003 - 0x0000 0004)
 +---------------------------+--------------+
 |0                        31|32          63|
@@ -107,6 +127,9 @@ SCREEN_CLEAR
 | write-only command stream | reserved ROM |
 +---------------------------+--------------+
 
+The command stream holds up to 4096 words per frame, a write to a full
+stream is dropped and sets the bus error.
+
 ### Timer (Addresses 0x0000 0005 - 0x0000 0006)
 +-----+--------------------------+-------------------------+
 |0  30|31                      31|32                     63|
@@ -652,7 +675,8 @@ enum class Channel {
 enum class ApuInstructionType {
     NOTE ,
     TEMPO,
-    DUTY_CYCLE_WINDOW
+    DUTY_CYCLE_WINDOW,
+    NOISE_MODE // noise channel only, value is a NoiseMode
 };
 
 enum class DutyCycleOption {
@@ -666,16 +690,27 @@ bool is_valid_value(const ApuInstructionType it);
 
 bool is_valid_value(Channel c);
 
+// period of the noise channel's shift register
+enum class NoiseMode {
+    LONG_PERIOD , // 32767 samples, hiss
+    SHORT_PERIOD  // 93 samples, a metallic buzz
+};
+
 bool is_valid_value(DutyCycleOption it);
 
+bool is_valid_value(NoiseMode mode);
+
 // ---------------------- GPU Constants/utility functions ---------------------
 
 namespace gpu_enum_types {
 
 enum GpuOpCode_e {
-    UPLOAD,
-    DRAW  ,
-    CLEAR ,
+    UPLOAD     ,
+    DRAW       ,
+    CLEAR      ,
+    DRAW_LIST  ,
+    TILE_MAP   ,
+    TILE_SCROLL,
 };
 
 } // end of gpu_enum_types namespace
@@ -20,8 +20,11 @@
 *****************************************************************************/
 
 #include "ErfiGpu.hpp"
+#include "SpscRing.hpp"
+#include "GpuPrivate/SpriteBlitter.hpp"
 
 #include <iostream>
+#include <random>
 
 #include <cassert>
 
@@ -29,24 +32,33 @@ namespace {
 
 using Error = std::runtime_error;
 using UInt32 = erfin::UInt32;
-
-static constexpr const UInt32 SIZE_BITS_MASK = 0x7 << 10;
+using VideoWord = erfin::VideoWord;
 
 template <typename Key, typename Value>
 Value & query(std::map<Key, Value> & map, const Key & k);
 
-template <typename T>
-T front_and_pop(std::queue<T> & queue);
+// longest command, identity included
+constexpr const std::size_t MAX_COMMAND_LENGTH = 5;
+
+void run_commands(erfin::GpuContext & ctx);
 
-void upload_sprite(erfin::GpuContext & ctx, const erfin::UInt32 * memory);
+// each handler is given its command's parameters
+void upload_sprite  (erfin::GpuContext & ctx, const UInt32 * params);
+void draw_sprite    (erfin::GpuContext & ctx, const UInt32 * params);
+void clear_screen   (erfin::GpuContext & ctx);
+void draw_list      (erfin::GpuContext & ctx, const UInt32 * params);
+void set_tile_map   (erfin::GpuContext & ctx, const UInt32 * params);
+void scroll_tile_map(erfin::GpuContext & ctx, const UInt32 * params);
 
-void draw_sprite  (erfin::GpuContext & ctx);
-void clear_screen (erfin::GpuContext & ctx);
+// the map pixel at scroll, which may be negative or past the end of the
+// map
+UInt32 wrap_scroll(UInt32 scroll, UInt32 map_size);
 
-bool queue_has_enough_for_top_instruction(const erfin::GpuContext *);
+// works out which rows of the frame just drawn differ from the screen
+void find_damaged_rows(erfin::GpuContext & drawn, const erfin::GpuContext & on_screen);
 
-UInt32 compute_size_of_sprite(UInt32 index);
-std::size_t convert_index_to_offset(UInt32 index);
+void to_damage_list
+    (const erfin::GpuContext & ctx, erfin::ErfiGpu::DamageList & damage);
 
 } // end of <anonymous> namespace
 
@@ -55,67 +67,91 @@ namespace erfin {
 struct GpuContext {
     using VideoMemory = ErfiGpu::VideoMemory;
 
-    std::queue<UInt32> command_buffer;
+    // set by TILE_MAP and TILE_SCROLL, off while width is zero
+    struct TileLayer {
+        TileLayer(): address(0), width(0), height(0), scroll_x(0), scroll_y(0) {}
+        UInt32 address;
+        UInt32 width;
+        UInt32 height;
+        UInt32 scroll_x;
+        UInt32 scroll_y;
+    };
+
+    using CommandBuffer = SpscRing<UInt32, ErfiGpu::COMMAND_CAPACITY>;
+    using RowSet        = std::bitset<ErfiGpu::SCREEN_HEIGHT>;
+
+    CommandBuffer      command_buffer;
     VideoMemory        pixels        ;
-    std::vector<bool>  sprite_memory ;
+    SpriteMemory       sprite_memory ;
+    // copy of memory at the end of the frame, the CPU keeps running (and
+    // writing to its memory) while the frame is drawn
+    MemorySpace        memory        ;
+    // rows drawn on (or cleared) while drawing the frame
+    RowSet             touched_rows  ;
+    // rows which differ from the buffer on screen while the frame was drawn
+    RowSet             damaged_rows  ;
+    TileLayer          tile_layer    ;
 };
 
-/* static */ const int ErfiGpu::SCREEN_WIDTH  = 320;
-/* static */ const int ErfiGpu::SCREEN_HEIGHT = 240;
+constexpr /* static */ const int ErfiGpu::BITS_PER_VIDEO_WORD;
+constexpr /* static */ const int ErfiGpu::SCREEN_WIDTH ;
+constexpr /* static */ const int ErfiGpu::SCREEN_HEIGHT;
+constexpr /* static */ const int ErfiGpu::WORDS_PER_ROW;
+constexpr /* static */ const std::size_t ErfiGpu::COMMAND_CAPACITY;
 
 ErfiGpu::ErfiGpu():
     m_cold(new GpuContext()),
     m_hot (new GpuContext())
 {
-    m_cold->pixels.resize(SCREEN_WIDTH*SCREEN_HEIGHT, false);
-    m_hot ->pixels.resize(SCREEN_WIDTH*SCREEN_HEIGHT, false);
-    m_hot ->sprite_memory.resize(128*128*4, false);
+    m_cold->pixels.resize(WORDS_PER_ROW*SCREEN_HEIGHT, 0);
+    m_hot ->pixels.resize(WORDS_PER_ROW*SCREEN_HEIGHT, 0);
+    m_hot ->sprite_memory.resize(SPRITE_MEMORY_BITS / VIDEO_WORD_BITS, 0);
 }
 
 ErfiGpu::~ErfiGpu() {
+    if (!m_gfx_thread.joinable()) return;
+    // the render thread finishes any frame already handed to it, commands
+    // since the last wait are dropped
     {
     std::unique_lock<std::mutex> lock(m_thread_control.mtx);
-    auto & hot = m_hot;
-    m_thread_control.gpu_ready.wait(lock, [&hot]()
-        { return hot->command_buffer.empty(); });
     m_thread_control.finish = true;
-    m_thread_control.buffer_ready.notify_one();
     }
-    if (m_gfx_thread.joinable())
-        m_gfx_thread.join();
+    m_thread_control.buffer_ready.notify_one();
+    m_gfx_thread.join();
 }
 
 void ErfiGpu::wait(MemorySpace & memory) {
-#   if 0
-    if (m_gfx_thread.joinable()) {
-        m_gpus_lock.lock();
-        m_thread_control.command_buffer_swaped = false;
-
-        bool & gpu_ready = m_thread_control.gpu_thread_ready;
-        m_thread_control.gpu_ready.wait(m_gpus_lock, [&gpu_ready]()
-            { return gpu_ready; });
-
-        m_cold.swap(m_hot);
-        // make sure sprite memory stays with hot
-        m_cold->sprite_memory.swap(m_hot->sprite_memory);
-        assert(!m_hot->sprite_memory.empty());
-        m_thread_control.command_buffer_swaped = true;
-
-        m_gpus_lock.unlock();
-        m_thread_control.buffer_ready.notify_one();
-    } else {
-        std::unique_lock<std::mutex> lock(m_thread_control.mtx);
-        m_gpus_lock.swap(lock);
-        m_gpus_lock.unlock();
-
-        std::thread t1(do_gpu_tasks, std::ref(m_hot), &memory[0], std::ref(m_thread_control));
+    // the cold context is only ever touched by this thread
+    m_cold->memory = memory;
+
+    std::unique_lock<std::mutex> lock(m_thread_control.mtx);
+    if (!m_gfx_thread.joinable()) {
+        // it blocks on the lock until this thread waits below
+        std::thread t1(do_gpu_tasks, std::ref(m_hot), std::cref(m_cold),
+                       std::ref(m_thread_control));
         m_gfx_thread.swap(t1);
     }
-#   endif
+    auto & tc = m_thread_control;
+    tc.gpu_ready.wait(lock, [&tc]() { return tc.gpu_thread_ready; });
+    if (tc.error) {
+        auto error = tc.error;
+        tc.error = nullptr;
+        m_damage.clear();
+        std::rethrow_exception(error);
+    }
+
     m_cold.swap(m_hot);
     // make sure sprite memory stays with hot
     m_cold->sprite_memory.swap(m_hot->sprite_memory);
-    do_gpu_tasks(m_hot, &memory[0], m_thread_control);
+    assert(!m_hot->sprite_memory.empty());
+    // as do the background layer's settings
+    std::swap(m_cold->tile_layer, m_hot->tile_layer);
+    to_damage_list(*m_cold, m_damage);
+    tc.command_buffer_swaped = true;
+    tc.gpu_thread_ready      = false;
+
+    lock.unlock();
+    tc.buffer_ready.notify_one();
 }
 
 void ErfiGpu::upload_sprite
@@ -125,27 +161,46 @@ void ErfiGpu::upload_sprite
         throw Error("Sprite index is invalid (improperly encoded).");
     }
     using namespace gpu_enum_types;
-    auto push_instr = [this] (UInt32 i) { m_cold->command_buffer.push(i); };
+    auto push_instr = [this] (UInt32 i) { push_command_word(i); };
     push_instr(UPLOAD );
-    push_instr(address);
     push_instr(width  );
     push_instr(height );
+    push_instr(address);
     push_instr(index  );
 }
 
 void ErfiGpu::draw_sprite(UInt32 x, UInt32 y, UInt32 index) {
-    m_cold->command_buffer.push(gpu_enum_types::DRAW);
-    m_cold->command_buffer.push(x);
-    m_cold->command_buffer.push(y);
-    m_cold->command_buffer.push(index);
+    push_command_word(gpu_enum_types::DRAW);
+    push_command_word(x);
+    push_command_word(y);
+    push_command_word(index);
 }
 
 void ErfiGpu::screen_clear() {
-    m_cold->command_buffer.push(gpu_enum_types::CLEAR);
+    push_command_word(gpu_enum_types::CLEAR);
+}
+
+void ErfiGpu::draw_list(UInt32 address, UInt32 count) {
+    push_command_word(gpu_enum_types::DRAW_LIST);
+    push_command_word(address);
+    push_command_word(count);
+}
+
+void ErfiGpu::set_tile_map(UInt32 address, UInt32 width, UInt32 height) {
+    push_command_word(gpu_enum_types::TILE_MAP);
+    push_command_word(address);
+    push_command_word(width);
+    push_command_word(height);
 }
 
-void ErfiGpu::io_write(UInt32 data) {
-    m_cold->command_buffer.push(data);
+void ErfiGpu::scroll_tile_map(UInt32 x, UInt32 y) {
+    push_command_word(gpu_enum_types::TILE_SCROLL);
+    push_command_word(x);
+    push_command_word(y);
+}
+
+bool ErfiGpu::io_write(UInt32 data) {
+    return m_cold->command_buffer.push(data);
 }
 
 UInt32 ErfiGpu::read() const {
@@ -158,61 +213,252 @@ const ErfiGpu::VideoMemory & ErfiGpu::current_screen() const {
 }
 
 /* static */ bool ErfiGpu::is_valid_sprite_index(UInt32 idx) {
-    switch (SIZE_BITS_MASK & idx) {
-    case 0 << 10: case 1 << 10: case 2 << 10: case 3 << 10: case 4 << 10:
-        break;
-    default: return false;
+    return (idx >> SPRITE_INDEX_BITS) == 0 && look_up_sprite_index(idx).valid;
+}
+
+/* static */ bool ErfiGpu::pixel_at(const VideoMemory & pixels, int x, int y) {
+    assert(x >= 0 && x < SCREEN_WIDTH && y >= 0 && y < SCREEN_HEIGHT);
+    auto word = pixels[std::size_t(y*WORDS_PER_ROW + x / BITS_PER_VIDEO_WORD)];
+    return ((word >> (BITS_PER_VIDEO_WORD - 1 - x % BITS_PER_VIDEO_WORD)) & 1)
+           != 0;
+}
+
+/* static */ void ErfiGpu::run_tests() {
+    run_sprite_blitter_tests();
+    // uploads are checked against the end of memory before anything is
+    // copied, one ending on the last word is fine
+    {
+    std::unique_ptr<MemorySpace> memory(new MemorySpace());
+    memory->fill(0);
+    const UInt32 last_two = UInt32(memory->size() - 2);
+    (*memory)[last_two] = 0xFF000000;
+    const UInt32 mini_index = 4 << 10;
+    ErfiGpu gpu;
+    gpu.upload_sprite(last_two, 8, 8, mini_index);
+    gpu.draw_sprite(0, 0, mini_index);
+    gpu.wait(*memory);
+    gpu.wait(*memory); // that frame is now on screen
+    for (int x = 0; x != 9; ++x) {
+        assert(pixel_at(gpu.current_screen(), x, 0) == (x < 8));
+        assert(!pixel_at(gpu.current_screen(), x, 1));
     }
-    auto active_quadrant_indicies = (SIZE_BITS_MASK & idx) >> 10;
-    UInt32 temp = idx;
-    for (UInt32 i = 0; i != 5; ++i) {
-        if (i > active_quadrant_indicies) {
-            if ((temp & 0x3) != 0) return false;
-        }
-        temp >>= 2;
+    // errors are reported by the wait after the frame is sent
+    bool threw = false;
+    gpu.upload_sprite(last_two + 1, 8, 8, mini_index);
+    gpu.wait(*memory);
+    try {
+        gpu.wait(*memory);
+    } catch (std::exception &) {
+        threw = true;
+    }
+    assert(threw);
+    (void)threw;
+    // the GPU keeps going after an error
+    gpu.draw_sprite(0, 0, mini_index);
+    gpu.wait(*memory);
+    gpu.wait(*memory);
+    assert(pixel_at(gpu.current_screen(), 0, 0));
+    }
+    // the command stream holds a fixed number of words per frame, anything
+    // past that is refused
+    {
+    ErfiGpu gpu;
+    for (std::size_t i = 0; i != COMMAND_CAPACITY; ++i) {
+        bool accepted = gpu.io_write(gpu_enum_types::CLEAR);
+        assert(accepted);
+        (void)accepted;
+    }
+    assert(!gpu.io_write(gpu_enum_types::CLEAR));
+    std::unique_ptr<MemorySpace> memory(new MemorySpace());
+    gpu.wait(*memory);
+    assert(gpu.io_write(gpu_enum_types::CLEAR));
+    }
+    // only rows which actually changed are reported, even if a frame clears
+    // and redraws the same things
+    {
+    std::unique_ptr<MemorySpace> memory(new MemorySpace());
+    memory->fill(0xFFFFFFFF);
+    const UInt32 mini_index = 4 << 10;
+    ErfiGpu gpu;
+    auto damage_is = [&gpu](int begin, int end) {
+        const auto & damage = gpu.screen_damage();
+        if (begin == end) return damage.empty();
+        return damage.size() == 1 && damage[0].begin == begin &&
+               damage[0].end == end;
+    };
+    gpu.upload_sprite(0, 8, 8, mini_index);
+    for (int i = 0; i != 3; ++i) {
+        gpu.screen_clear();
+        gpu.draw_sprite(0, 10, mini_index);
+        gpu.wait(*memory);
+    }
+    // the third frame is on screen, same as the second
+    gpu.screen_clear();
+    gpu.wait(*memory);
+    assert(damage_is(0, 0));
+    // now the cleared one
+    gpu.wait(*memory);
+    assert(damage_is(10, 18));
+    (void)damage_is;
+    }
+    // a draw list draws exactly what the same draws one at a time would,
+    // and is checked against the end of memory before anything is drawn
+    {
+    std::unique_ptr<MemorySpace> memory(new MemorySpace());
+    memory->fill(0xFFFFFFFF);
+    const UInt32 small_index = 3 << 10;
+    const UInt32 records[][3] = {
+        { 0, 0, small_index }, { 100, 20, small_index }, { 310, 230, small_index },
+        { 4, 4, small_index }
+    };
+    const UInt32 list_address = 1000;
+    UInt32 * record_words = &(*memory)[list_address];
+    for (const auto & record : records) {
+        for (UInt32 word : record) *record_words++ = word;
+    }
+    ErfiGpu one_at_a_time, listed;
+    for (auto * gpu : { &one_at_a_time, &listed }) {
+        gpu->upload_sprite(0, 16, 16, small_index);
+        gpu->wait(*memory);
+    }
+    for (const auto & record : records)
+        one_at_a_time.draw_sprite(record[0], record[1], record[2]);
+    listed.draw_list(list_address, 4);
+    for (auto * gpu : { &one_at_a_time, &listed }) {
+        gpu->wait(*memory);
+        gpu->wait(*memory);
+    }
+    assert(one_at_a_time.current_screen() == listed.current_screen());
+    assert(pixel_at(listed.current_screen(), 4, 4) == false);
+    assert(pixel_at(listed.current_screen(), 16, 16) == true);
+
+    bool threw = false;
+    listed.screen_clear();
+    listed.draw_list(UInt32(memory->size() - 5), 2);
+    listed.wait(*memory);
+    try {
+        listed.wait(*memory);
+    } catch (std::exception &) {
+        threw = true;
+    }
+    assert(threw);
+    (void)threw;
+    // a list ending on the last word is fine
+    listed.draw_list(UInt32(memory->size() - 6), 2);
+    listed.wait(*memory);
+    listed.wait(*memory);
+    }
+    // a clear draws the background layer, scrolled and repeated in both
+    // directions, which must match looking up every pixel's tile
+    {
+    std::unique_ptr<MemorySpace> memory(new MemorySpace());
+    memory->fill(0);
+    std::mt19937 rng(0x711E);
+    const UInt32 tile_a = (4 << 10) | 0x001;
+    const UInt32 tile_b = (4 << 10) | 0x2A7;
+    const UInt32 small  =  3 << 10; // not a tile, so left blank
+    for (int i = 0; i != 4; ++i) (*memory)[std::size_t(i)] = UInt32(rng());
+    // a map which does not evenly divide the screen
+    const UInt32 map_address = 100, map_width = 7, map_height = 5;
+    const UInt32 tile_cycle[] = { tile_a, tile_b, 0, small, tile_b };
+    for (UInt32 i = 0; i != map_width*map_height; ++i)
+        (*memory)[map_address + i] = tile_cycle[(i*3) % 5];
+
+    auto expected_pixel = [&memory](int x, int y) {
+        const int map_px_width = map_width*8, map_px_height = map_height*8;
+        x = (x % map_px_width  + map_px_width ) % map_px_width ;
+        y = (y % map_px_height + map_px_height) % map_px_height;
+        UInt32 tile = (*memory)[std::size_t(map_address + UInt32(y / 8)*map_width + UInt32(x / 8))];
+        if (tile != tile_a && tile != tile_b) return false;
+        int bit = (y % 8)*8 + x % 8;
+        UInt32 word = (*memory)[std::size_t((tile == tile_a ? 0 : 2) + bit / 32)];
+        return ((word >> (31 - bit % 32)) & 1) != 0;
+    };
+    ErfiGpu gpu;
+    gpu.upload_sprite(0, 8, 8, tile_a);
+    gpu.upload_sprite(2, 8, 8, tile_b);
+    gpu.set_tile_map(map_address, map_width, map_height);
+    const int scrolls[][2] = { { 0, 0 }, { 3, 13 }, { -5, -1 }, { 8*7*3, 41 } };
+    for (const auto & scroll : scrolls) {
+        gpu.scroll_tile_map(UInt32(scroll[0]), UInt32(scroll[1]));
+        gpu.screen_clear();
+        gpu.wait(*memory);
+        gpu.wait(*memory);
+        for (int y = 0; y != SCREEN_HEIGHT; ++y) {
+        for (int x = 0; x != SCREEN_WIDTH ; ++x) {
+            assert(pixel_at(gpu.current_screen(), x, y) ==
+                   expected_pixel(x + scroll[0], y + scroll[1]));
+        }}
+    }
+    // a zero size map turns the layer off
+    gpu.set_tile_map(0, 0, 0);
+    gpu.screen_clear();
+    gpu.wait(*memory);
+    gpu.wait(*memory);
+    for (auto word : gpu.current_screen()) assert(word == 0);
+    // maps are checked against the end of memory
+    bool threw = false;
+    gpu.set_tile_map(UInt32(memory->size() - 11), 4, 3);
+    gpu.wait(*memory);
+    try {
+        gpu.wait(*memory);
+    } catch (std::exception &) {
+        threw = true;
+    }
+    assert(threw);
+    (void)threw; (void)expected_pixel;
+    }
+    // frames sent are drawn in order, even if the GPU is destroyed right
+    // after the last one is sent
+    {
+    std::unique_ptr<MemorySpace> memory(new MemorySpace());
+    memory->fill(0xFFFFFFFF);
+    const UInt32 mega_index = 0;
+    std::unique_ptr<ErfiGpu> gpu(new ErfiGpu());
+    gpu->upload_sprite(0, 128, 128, mega_index);
+    for (int i = 0; i != 100; ++i) {
+        gpu->draw_sprite(UInt32(i), UInt32(i), mega_index);
+        gpu->wait(*memory);
+    }
+    gpu->wait(*memory);
+    // the screen alternates between two buffers, the one now on screen had
+    // every odd frame drawn on it
+    assert(!pixel_at(gpu->current_screen(), 0, 0));
+    assert( pixel_at(gpu->current_screen(), 1, 1));
+    assert( pixel_at(gpu->current_screen(), 2, 2));
+    assert(!pixel_at(gpu->current_screen(), 3, 3));
+    gpu.reset();
     }
-    return (idx >> 13) == 0;
+}
+
+/* private */ void ErfiGpu::push_command_word(UInt32 word) {
+    if (!io_write(word))
+        throw Error("GPU command stream is full.");
 }
 
 /* private static */ void ErfiGpu::do_gpu_tasks
-    (std::unique_ptr<GpuContext> & context, const UInt32 * memory, ThreadControl & tc)
+    (std::unique_ptr<GpuContext> & context,
+     const std::unique_ptr<GpuContext> & on_screen, ThreadControl & tc)
 {
-    (void)tc;
-    using namespace gpu_enum_types;
-
     while (true) {
-#       if 0
+        {
         std::unique_lock<std::mutex> lock(tc.mtx);
         tc.gpu_thread_ready = true;
         tc.gpu_ready.notify_one();
         tc.buffer_ready.wait(lock, [&tc]()
             { return tc.command_buffer_swaped || tc.finish; });
-        tc.gpu_thread_ready = false;
-#       endif
-        while (!context->command_buffer.empty()) {
-            // reason's for invalid gpu instructions:
-            // - forced waits
-            // - malformed programs
-            if (!is_valid_gpu_op_code(context->command_buffer.front())) {
-                context->command_buffer.pop();
-                continue;
-            }
-
-            // stop instruction process if there isn't enough for the next
-            // instruction
-            if (!queue_has_enough_for_top_instruction(context.get())) break;
-
-            switch (front_and_pop(context->command_buffer)) {
-            case UPLOAD: ::upload_sprite(*context, memory); break;
-            case DRAW  : ::draw_sprite  (*context); break;
-            case CLEAR : ::clear_screen (*context); break;
-            default: break;
-            }
+        if (!tc.command_buffer_swaped) return;
+        tc.command_buffer_swaped = false;
         }
-#       if 0
-        if (tc.finish) return;
-#       endif
-        return;
+        // the context is not swapped out until this thread is ready again
+        try {
+            run_commands(*context);
+        } catch (...) {
+            std::unique_lock<std::mutex> lock(tc.mtx);
+            tc.error = std::current_exception();
+            context->command_buffer.clear();
+        }
+        find_damaged_rows(*context, *on_screen);
     }
 }
 
@@ -220,7 +466,47 @@ const ErfiGpu::VideoMemory & ErfiGpu::current_screen() const {
 
 namespace {
 
-std::size_t coord_to_index(erfin::UInt32 x, erfin::UInt32 y);
+void run_commands(erfin::GpuContext & ctx) {
+    using namespace erfin;
+    using namespace gpu_enum_types;
+    auto & commands = ctx.command_buffer;
+    while (!commands.empty()) {
+        // reason's for invalid gpu instructions:
+        // - forced waits
+        // - malformed programs
+        UInt32 code = commands.peek();
+        if (!is_valid_gpu_op_code(code)) {
+            commands.pop();
+            continue;
+        }
+
+        // stop instruction process if there isn't enough for the next
+        // instruction
+        auto length = std::size_t(1 + parameters_per_instruction(GpuOpCode(code)));
+        assert(length <= MAX_COMMAND_LENGTH);
+        if (commands.size() < length) break;
+
+        // parameters are read straight out of the ring, unless the command
+        // wraps around its end
+        UInt32 unwrapped[MAX_COMMAND_LENGTH];
+        const UInt32 * command = commands.front_span().data;
+        if (commands.front_span().size < length) {
+            for (std::size_t i = 0; i != length; ++i)
+                unwrapped[i] = commands.peek(i);
+            command = unwrapped;
+        }
+        switch (code) {
+        case UPLOAD     : upload_sprite  (ctx, command + 1); break;
+        case DRAW       : draw_sprite    (ctx, command + 1); break;
+        case CLEAR      : clear_screen   (ctx); break;
+        case DRAW_LIST  : draw_list      (ctx, command + 1); break;
+        case TILE_MAP   : set_tile_map   (ctx, command + 1); break;
+        case TILE_SCROLL: scroll_tile_map(ctx, command + 1); break;
+        default: break;
+        }
+        commands.pop(length);
+    }
+}
 
 template <typename Key, typename Value>
 Value & query(std::map<Key, Value> & map, const Key & k) {
@@ -230,121 +516,144 @@ Value & query(std::map<Key, Value> & map, const Key & k) {
     return itr->second;
 }
 
-template <typename T>
-T front_and_pop(std::queue<T> & queue) {
-    assert(!queue.empty());
-    T rv = queue.front();
-    queue.pop();
-    return rv;
-}
-
-void upload_sprite(erfin::GpuContext & ctx, const erfin::UInt32 * memory) {
+void upload_sprite(erfin::GpuContext & ctx, const UInt32 * params) {
     using namespace erfin;
-    auto & queue = ctx.command_buffer;
-
-    UInt32 width   = front_and_pop(queue);
-    UInt32 height  = front_and_pop(queue);
-    UInt32 address = front_and_pop(queue);
-    UInt32 index   = front_and_pop(queue);
+    auto & memory = ctx.memory;
 
-    UInt32 dest_size = compute_size_of_sprite(index);
+    UInt32 width   = params[0];
+    UInt32 height  = params[1];
+    UInt32 address = params[2];
+    UInt32 index   = params[3];
 
+    UInt32 dest_size = look_up_sprite_index(index).size;
+    if (dest_size == 0)
+        throw Error("Invalid sprite index: invalid size bits...");
     if (width > dest_size || height > dest_size) {
         throw Error("Width and/or height exceed sprite cell size.");
     }
-
-    const UInt32 * start = &memory[address];
-    const UInt32 * end   = start + (width*height)/32 +
-                           ( (width*height % 32) ? 1 : 0 );
-    (void)end; // needed in debug mode -> make sure we don't overrun the buffer
-    // lets just one bit at a time, we ALWAYS have time to micro-optimize
-    // later
-    auto dest_offset = convert_index_to_offset(index);
-    std::bitset<32> line32 = *start;
-    UInt32 bit_pos = 0;
-    for (UInt32 y = 0; y != height; ++y) {
-        for (UInt32 x = 0; x != width ; ++x) {
-            ctx.sprite_memory[dest_offset + x] = line32[31 - (bit_pos % 32)];
-            ++bit_pos;
-            if (bit_pos % 32 == 0) {
-                line32 = *++start;
-                assert(start != end || bit_pos == width*height);
-            }
-        }
-        dest_offset += dest_size;
+    // both are at most 128, so this cannot overflow
+    const UInt32 word_count = (width*height + 31) / 32;
+    if (address > memory.size() || word_count > memory.size() - address) {
+        throw Error("Sprite upload reads past the end of memory.");
     }
+    upload_sprite_bits(ctx.sprite_memory, memory.data() + address, width,
+                       height, index);
 }
 
-template <typename BoolRef>
-void xor_set(BoolRef dest, BoolRef arg) {
-    dest = dest ^ arg;
+void draw_sprite(erfin::GpuContext & ctx, const UInt32 * params) {
+    using erfin::ErfiGpu;
+    UInt32 x     = params[0];
+    UInt32 y     = params[1];
+    UInt32 index = params[2];
+    erfin::xor_sprite(ctx.pixels, ctx.sprite_memory, x, y, index);
+    if (x >= UInt32(ErfiGpu::SCREEN_WIDTH) || y >= UInt32(ErfiGpu::SCREEN_HEIGHT))
+        return;
+    auto end = std::min(y + erfin::look_up_sprite_index(index).size,
+                        UInt32(ErfiGpu::SCREEN_HEIGHT));
+    for (; y != end; ++y) ctx.touched_rows.set(y);
 }
 
-void draw_sprite(erfin::GpuContext & ctx) {
-    using namespace erfin;
-
-    UInt32 x_         = front_and_pop(ctx.command_buffer);
-    UInt32 y_         = front_and_pop(ctx.command_buffer);
-    UInt32 text_index = front_and_pop(ctx.command_buffer);
-
-    const UInt32 SCREEN_WIDTH  = UInt32(ErfiGpu::SCREEN_WIDTH );
-    const UInt32 SCREEN_HEIGHT = UInt32(ErfiGpu::SCREEN_HEIGHT);
-
-    auto text_size   = compute_size_of_sprite (text_index);
-    auto text_offset = convert_index_to_offset(text_index);
-
-    // grab the bits and render (using xor)
-    for (UInt32 y = y_; (y - y_) != text_size && y < SCREEN_HEIGHT; ++y) {
-    for (UInt32 x = x_; (x - x_) != text_size && x < SCREEN_WIDTH ; ++x) {
-        //                                                       v as width
-        std::size_t from_index = std::size_t((x - x_) + (y - y_)*text_size);
-        assert(coord_to_index(x, y) < ctx.pixels.size());
-        assert(text_offset + from_index < ctx.sprite_memory.size());
-        xor_set(ctx.pixels       [coord_to_index(x, y)    ],
-                ctx.sprite_memory[text_offset + from_index]);
-    }}
+void draw_list(erfin::GpuContext & ctx, const UInt32 * params) {
+    static constexpr const std::size_t RECORD_LENGTH = 3; // x, y, index
+    const auto & memory = ctx.memory;
+    std::size_t address = params[0];
+    std::size_t count   = params[1];
+    // count may be anything, so the record count is what's checked
+    if (address > memory.size() ||
+        count > (memory.size() - address) / RECORD_LENGTH)
+    {
+        throw Error("Draw list reads past the end of memory.");
+    }
+    // records have the same layout as a DRAW command's parameters
+    for (const UInt32 * record = memory.data() + address;
+         count != 0; --count, record += RECORD_LENGTH)
+    { draw_sprite(ctx, record); }
 }
 
-void clear_screen(erfin::GpuContext & ctx) {
-    std::fill(ctx.pixels.begin(), ctx.pixels.end(), false);
+void set_tile_map(erfin::GpuContext & ctx, const UInt32 * params) {
+    const auto & memory = ctx.memory;
+    auto & layer = ctx.tile_layer;
+    UInt32 address = params[0];
+    UInt32 width   = params[1];
+    UInt32 height  = params[2];
+    if (width == 0 || height == 0) {
+        layer.width = layer.height = 0;
+        return;
+    }
+    // the map is read at each clear, but memory never changes size, so it
+    // only needs checking here
+    if (address > memory.size() ||
+        erfin::UInt64(width)*height > memory.size() - address)
+    {
+        throw Error("Tile map reads past the end of memory.");
+    }
+    layer.address = address;
+    layer.width   = width;
+    layer.height  = height;
 }
 
-bool queue_has_enough_for_top_instruction(const erfin::GpuContext * context) {
-    using namespace erfin;
-    auto code = static_cast<GpuOpCode>(context->command_buffer.front());
-    assert(is_valid_gpu_op_code(code));
-    int left_after_code = int(context->command_buffer.size() - 1);
-    return left_after_code >= parameters_per_instruction(code);
+void scroll_tile_map(erfin::GpuContext & ctx, const UInt32 * params) {
+    ctx.tile_layer.scroll_x = params[0];
+    ctx.tile_layer.scroll_y = params[1];
 }
 
-UInt32 compute_size_of_sprite(UInt32 index) {
-    // 0 -> mega
-    // 1 -> large
-    // 2 -> medium
-    // 3 -> small
-    // 4 -> mini
-    // size mask, number of bits used to encode which "sprite" to use
-    UInt32 bits_used = (SIZE_BITS_MASK & index) >> 10;
-    if (bits_used > 4)
-        throw Error("Invalid sprite index: invalid size bits...");
-    return 128 >> bits_used;
+UInt32 wrap_scroll(UInt32 scroll, UInt32 map_size) {
+    auto rv = std::int64_t(erfin::Int32(scroll)) % std::int64_t(map_size);
+    return UInt32(rv < 0 ? rv + map_size : rv);
 }
 
-std::size_t convert_index_to_offset(UInt32 index) {
-    std::size_t rv = 0;
-    std::size_t current_quad_size = 128*128; // 14
-    for (UInt32 i = ((index >> 10) & 0x7) + 1; i != 0; --i) {
-        // position in increasing level of specifity
-        rv += current_quad_size*(index & 0x3);
+void clear_screen(erfin::GpuContext & ctx) {
+    using namespace erfin;
+    ctx.touched_rows.set();
+    const auto & layer = ctx.tile_layer;
+    if (layer.width == 0) {
+        // a plain memset
+        std::fill(ctx.pixels.begin(), ctx.pixels.end(), VideoWord(0));
+        return;
+    }
+    // the map fits in memory, so neither size can overflow
+    TileMap map;
+    map.tiles    = ctx.memory.data() + layer.address;
+    map.width    = layer.width;
+    map.height   = layer.height;
+    map.scroll_x = wrap_scroll(layer.scroll_x, layer.width *TILE_SIZE);
+    map.scroll_y = wrap_scroll(layer.scroll_y, layer.height*TILE_SIZE);
+    draw_tile_map(ctx.pixels, ctx.sprite_memory, map);
+}
 
-        current_quad_size /= 4; // -2
-        index             >>= 2;
+void find_damaged_rows
+    (erfin::GpuContext & drawn, const erfin::GpuContext & on_screen)
+{
+    using erfin::ErfiGpu;
+    // The two buffers alternate, so a row may differ from the screen if it
+    // was drawn on this frame, or if it changed when the buffer on screen
+    // was drawn. Only those rows are compared.
+    const std::size_t words_per_row = std::size_t(ErfiGpu::WORDS_PER_ROW);
+    auto candidates = drawn.touched_rows | on_screen.damaged_rows;
+    drawn.damaged_rows.reset();
+    for (std::size_t y = 0; y != candidates.size(); ++y) {
+        if (!candidates[y]) continue;
+        auto row = drawn.pixels.begin() + std::ptrdiff_t(y*words_per_row);
+        if (!std::equal(row, row + std::ptrdiff_t(words_per_row),
+                        on_screen.pixels.begin() + std::ptrdiff_t(y*words_per_row)))
+        { drawn.damaged_rows.set(y); }
     }
-    return rv;
+    drawn.touched_rows.reset();
 }
 
-std::size_t coord_to_index(erfin::UInt32 x, erfin::UInt32 y) {
-    return std::size_t(x + y*erfin::ErfiGpu::SCREEN_WIDTH);
+void to_damage_list
+    (const erfin::GpuContext & ctx, erfin::ErfiGpu::DamageList & damage)
+{
+    using erfin::ErfiGpu;
+    damage.clear();
+    const auto & rows = ctx.damaged_rows;
+    for (int y = 0; y != ErfiGpu::SCREEN_HEIGHT; ++y) {
+        if (!rows[std::size_t(y)]) continue;
+        if (!damage.empty() && damage.back().end == y)
+            ++damage.back().end;
+        else
+            damage.push_back(ErfiGpu::RowSpan { y, y + 1 });
+    }
 }
 
 } // end of <anonymous> namespace
@@ -29,20 +29,51 @@
 #include <vector>
 #include <thread>
 #include <memory>
+#include <mutex>
 #include <bitset>
+#include <exception>
 #include <condition_variable>
 
 namespace erfin {
 
 struct GpuContext; // implementation detail
 
+/** Commands for a frame are drawn on a render thread, while the CPU runs
+ *  the next frame. The screen always shows the last frame the render thread
+ *  finished, so a frame is on screen one wait after it was sent.
+ */
 class ErfiGpu {
 public:
     using MiniSprite = std::bitset<MINI_SPRITE_BIT_COUNT>;
-    using VideoMemory = std::vector<bool>;
 
-    static const int SCREEN_WIDTH;
-    static const int SCREEN_HEIGHT;
+    // video and sprite memory hold one bit per pixel, packed into words with
+    // the most significant bit as the leftmost pixel
+    using VideoWord = UInt64;
+    static constexpr const int BITS_PER_VIDEO_WORD = 64;
+
+    /** The screen row by row, each row is exactly WORDS_PER_ROW words. */
+    using VideoMemory = std::vector<VideoWord>;
+
+    static constexpr const int SCREEN_WIDTH  = 320;
+    static constexpr const int SCREEN_HEIGHT = 240;
+    static constexpr const int WORDS_PER_ROW = SCREEN_WIDTH / BITS_PER_VIDEO_WORD;
+
+    static_assert(SCREEN_WIDTH % BITS_PER_VIDEO_WORD == 0,
+                  "Rows must not share words.");
+
+    /** Rows [begin, end) of the screen. */
+    struct RowSpan {
+        int begin;
+        int end;
+    };
+
+    /** Rows of the screen which changed, in increasing order, spans never
+     *  touch or overlap.
+     */
+    using DamageList = std::vector<RowSpan>;
+
+    /** Most words the command stream holds per frame. */
+    static constexpr const std::size_t COMMAND_CAPACITY = 1 << 16;
 
     ErfiGpu();
     ~ErfiGpu();
@@ -50,8 +81,9 @@ public:
     // finishes all previous draw operations
     // swaps command buffers
     // swaps graphics buffers
-    // waits for frame time, time out
-    // begins/resumes all draw operations
+    // begins drawing this frame's commands on the render thread
+    // (uploads read memory as it was at this call)
+    // throws any error from drawing the previous frame
     void wait(MemorySpace & mem);
 
     // high-level functions
@@ -61,8 +93,19 @@ public:
     void draw_sprite  (UInt32 x, UInt32 y, UInt32 index);
     void screen_clear ();
 
+    // draws count sprites, from (x, y, index) records packed one after
+    // another in memory starting at address (records are read as memory
+    // was at the wait, same as uploads)
+    void draw_list    (UInt32 address, UInt32 count);
+
+    // background layer of 8x8 tiles, which every screen clear draws
+    // (rather than blanking the screen), see TILE_MAP in ErfiDefs.hpp
+    void set_tile_map   (UInt32 address, UInt32 width, UInt32 height);
+    void scroll_tile_map(UInt32 x, UInt32 y);
+
     // low-level functions
-    void io_write(UInt32);
+    // @return false if the command stream is full (the word is dropped)
+    bool io_write(UInt32);
     UInt32 read() const;
 
     // you know what?
@@ -73,8 +116,18 @@ public:
 
     const VideoMemory & current_screen() const;
 
+    /** @return rows of current_screen() which differ from the screen
+     *          shown before the last wait (a consumer which skips frames
+     *          must combine the damage of every frame it skipped)
+     */
+    const DamageList & screen_damage() const { return m_damage; }
+
     static bool is_valid_sprite_index(UInt32);
 
+    static bool pixel_at(const VideoMemory &, int x, int y);
+
+    static void run_tests();
+
 private:
     using CondVar = std::condition_variable;
     friend struct GpuContext;
@@ -89,19 +142,27 @@ private:
         bool finish;
         bool gpu_thread_ready;
         bool command_buffer_swaped;
+        // from the last frame drawn, until rethrown by wait
+        std::exception_ptr error;
     };
 
+    // throws if the command stream is full
+    void push_command_word(UInt32);
+
+    // render thread's loop, draws the hot context each time it is handed
+    // a new one
+    // on_screen is only read, to find which rows the frame changed
     static void do_gpu_tasks
-        (std::unique_ptr<GpuContext> & context, const UInt32 * memory,
-         ThreadControl & cv);
+        (std::unique_ptr<GpuContext> & context,
+         const std::unique_ptr<GpuContext> & on_screen, ThreadControl & tc);
 
     ThreadControl m_thread_control;
     std::thread m_gfx_thread;
 
-    std::unique_lock<std::mutex> m_gpus_lock;
-
     std::unique_ptr<GpuContext> m_cold;
     std::unique_ptr<GpuContext> m_hot ; // hot as in "touch it and get burned"
+
+    DamageList m_damage;
 };
 
 } // end of erfin namespace
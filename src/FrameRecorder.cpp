@@ -0,0 +1,370 @@
+/****************************************************************************
+
+    File: FrameRecorder.cpp
+    Author: Andrew Janke
+    License: GPLv3
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*****************************************************************************/
+
+#include "FrameRecorder.hpp"
+
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+
+#include <cassert>
+#include <cstring>
+
+namespace {
+
+using Error = std::runtime_error;
+using UInt8  = erfin::UInt8 ;
+using UInt16 = erfin::UInt16;
+using UInt32 = erfin::UInt32;
+using VideoWord = erfin::ErfiGpu::VideoWord;
+
+constexpr const char * const MAGIC = "ERFIFRM1";
+constexpr const std::size_t MAGIC_LENGTH = 8;
+constexpr const int WORDS_PER_ROW = erfin::ErfiGpu::WORDS_PER_ROW;
+constexpr const std::size_t BYTES_PER_ROW =
+    std::size_t(erfin::ErfiGpu::SCREEN_WIDTH / 8);
+
+void push_uint16(std::vector<char> & buffer, UInt16 value);
+
+void push_uint32(std::vector<char> & buffer, UInt32 value);
+
+// rows are written a byte at a time, so the file does not depend on the
+// host's byte order
+void push_rows
+    (std::vector<char> & buffer, const VideoWord * words, std::size_t count);
+
+// @return false if fewer than count bytes could be read
+bool read_bytes(std::istream & in, char * dest, std::size_t count);
+
+UInt16 read_uint16(std::istream & in);
+
+UInt32 read_uint32(std::istream & in);
+
+Error make_truncated_error();
+
+} // end of <anonymous> namespace
+
+namespace erfin {
+
+constexpr /* static */ const std::size_t FrameRecorder::WRITE_BATCH_SIZE;
+constexpr /* static */ const std::size_t FrameRecorder::MAX_PENDING_FRAMES;
+
+FrameRecorder::FrameRecorder(std::ostream & out):
+    m_out(&out),
+    m_frame_number(0),
+    m_finishing(false)
+{
+    std::vector<char> header(MAGIC, MAGIC + MAGIC_LENGTH);
+    push_uint16(header, UInt16(ErfiGpu::SCREEN_WIDTH ));
+    push_uint16(header, UInt16(ErfiGpu::SCREEN_HEIGHT));
+    out.write(header.data(), std::streamsize(header.size()));
+    if (!out) throw Error("Failed to write the frame recording's header.");
+    std::thread writer(&FrameRecorder::write_frames, this);
+    m_writer.swap(writer);
+}
+
+FrameRecorder::~FrameRecorder() {
+    try {
+        finish();
+    } catch (...) {
+        // only finish reports errors
+    }
+}
+
+void FrameRecorder::record(const VideoMemory & screen, const DamageList & damage) {
+    assert(screen.size() == std::size_t(WORDS_PER_ROW*ErfiGpu::SCREEN_HEIGHT));
+    PendingFrame frame;
+    {
+    std::unique_lock<std::mutex> lock(m_mtx);
+    assert(!m_finishing);
+    throw_if_failed();
+    // the writer falling behind holds the console back, rather than
+    // letting frames pile up without end
+    m_frame_written.wait(lock, [this]()
+        { return m_pending.size() < MAX_PENDING_FRAMES || m_error; });
+    throw_if_failed();
+    if (!m_spares.empty()) {
+        std::swap(frame, m_spares.back());
+        m_spares.pop_back();
+    }
+    }
+
+    // copied outside the lock, the writer never sees this frame until it is
+    // queued
+    frame.number = m_frame_number++;
+    frame.damage = damage;
+    frame.rows.clear();
+    for (const auto & span : damage) {
+        frame.rows.insert(frame.rows.end(),
+                          screen.begin() + span.begin*WORDS_PER_ROW,
+                          screen.begin() + span.end  *WORDS_PER_ROW);
+    }
+
+    bool batch_ready = false;
+    {
+    std::unique_lock<std::mutex> lock(m_mtx);
+    m_pending.emplace_back();
+    std::swap(m_pending.back(), frame);
+    batch_ready = m_pending.size() == WRITE_BATCH_SIZE;
+    }
+    if (batch_ready) m_frame_pending.notify_one();
+}
+
+void FrameRecorder::finish() {
+    if (m_writer.joinable()) {
+        {
+        std::unique_lock<std::mutex> lock(m_mtx);
+        m_finishing = true;
+        }
+        m_frame_pending.notify_one();
+        m_writer.join();
+        if (!m_error && !m_out->flush())
+            m_error = std::make_exception_ptr(Error("Failed to flush the frame recording."));
+    }
+    throw_if_failed();
+}
+
+/* static */ void FrameRecorder::run_tests() {
+    // every frame read back matches the screen recorded, the damage is made
+    // by comparing rows here, as the GPU would
+    {
+    std::mt19937 rng(0xF4A3E);
+    const std::size_t word_count = std::size_t(WORDS_PER_ROW*ErfiGpu::SCREEN_HEIGHT);
+    std::vector<VideoMemory> screens;
+    VideoMemory blank(word_count, 0);
+    VideoMemory screen = blank;
+    for (int i = 0; i != 100; ++i) {
+        // some frames change nothing
+        for (int changes = int(rng() % 4); changes != 0; --changes)
+            screen[rng() % word_count] ^= (VideoWord(rng()) << 32) | rng();
+        screens.push_back(screen);
+    }
+
+    std::stringstream recording;
+    {
+    FrameRecorder recorder(recording);
+    const VideoMemory * previous = &blank;
+    for (const auto & current : screens) {
+        DamageList damage;
+        for (int y = 0; y != ErfiGpu::SCREEN_HEIGHT; ++y) {
+            bool changed = !std::equal
+                (current.begin() + y*WORDS_PER_ROW,
+                 current.begin() + (y + 1)*WORDS_PER_ROW,
+                 previous->begin() + y*WORDS_PER_ROW);
+            if (!changed) continue;
+            if (!damage.empty() && damage.back().end == y)
+                ++damage.back().end;
+            else
+                damage.push_back(ErfiGpu::RowSpan { y, y + 1 });
+        }
+        recorder.record(current, damage);
+        previous = &current;
+    }
+    recorder.finish();
+    }
+    // only changed rows are stored
+    assert(recording.str().size() < screens.size()*word_count*sizeof(VideoWord) / 10);
+
+    FrameReader reader(recording);
+    for (std::size_t i = 0; i != screens.size(); ++i) {
+        bool read = reader.read_next();
+        assert(read);
+        assert(reader.frame_number() == UInt32(i));
+        assert(reader.screen() == screens[i]);
+        (void)read;
+    }
+    assert(!reader.read_next());
+    }
+    // errors writing are reported
+    {
+    std::stringstream broken;
+    FrameRecorder recorder(broken);
+    broken.setstate(std::ios_base::badbit);
+    bool threw = false;
+    try {
+        recorder.record(VideoMemory(std::size_t(WORDS_PER_ROW*ErfiGpu::SCREEN_HEIGHT), 0),
+                        DamageList { ErfiGpu::RowSpan { 0, 1 } });
+        recorder.finish();
+    } catch (std::exception &) {
+        threw = true;
+    }
+    assert(threw);
+    (void)threw;
+    }
+    // which is not a recording
+    {
+    std::stringstream not_a_recording("P4\n320 240\n");
+    bool threw = false;
+    try {
+        FrameReader reader(not_a_recording);
+    } catch (std::exception &) {
+        threw = true;
+    }
+    assert(threw);
+    (void)threw;
+    }
+}
+
+/* private */ void FrameRecorder::write_frames() {
+    std::vector<char> bytes;
+    std::deque<PendingFrame> batch;
+    std::unique_lock<std::mutex> lock(m_mtx);
+    while (true) {
+        m_frame_pending.wait(lock, [this]()
+            { return m_pending.size() >= WRITE_BATCH_SIZE || m_finishing; });
+        if (m_pending.empty()) return;
+
+        // everything pending is written at once
+        batch.swap(m_pending);
+        lock.unlock();
+
+        bytes.clear();
+        for (const auto & frame : batch) {
+            push_uint32(bytes, frame.number);
+            push_uint16(bytes, UInt16(frame.damage.size()));
+            const VideoWord * rows = frame.rows.data();
+            for (const auto & span : frame.damage) {
+                auto count = std::size_t(span.end - span.begin);
+                push_uint16(bytes, UInt16(span.begin));
+                push_uint16(bytes, UInt16(count));
+                push_rows(bytes, rows, count);
+                rows += count*WORDS_PER_ROW;
+            }
+        }
+        bool failed = !m_out->write(bytes.data(), std::streamsize(bytes.size()));
+        lock.lock();
+
+        if (failed && !m_error)
+            m_error = std::make_exception_ptr(Error("Failed to write to the frame recording."));
+        for (auto & frame : batch) {
+            m_spares.emplace_back();
+            std::swap(m_spares.back(), frame);
+        }
+        batch.clear();
+        m_frame_written.notify_one();
+    }
+}
+
+/* private */ void FrameRecorder::throw_if_failed() {
+    if (m_error) std::rethrow_exception(m_error);
+}
+
+// ----------------------------------------------------------------------------
+
+FrameReader::FrameReader(std::istream & in):
+    m_in(&in),
+    m_screen(std::size_t(WORDS_PER_ROW*ErfiGpu::SCREEN_HEIGHT), 0),
+    m_frame_number(0)
+{
+    char magic[MAGIC_LENGTH];
+    if (!read_bytes(in, magic, MAGIC_LENGTH) ||
+        std::memcmp(magic, MAGIC, MAGIC_LENGTH) != 0)
+    {
+        throw Error("Stream is not a frame recording.");
+    }
+    if (read_uint16(in) != ErfiGpu::SCREEN_WIDTH ||
+        read_uint16(in) != ErfiGpu::SCREEN_HEIGHT)
+    {
+        throw Error("Frame recording's screen size does not match.");
+    }
+}
+
+bool FrameReader::read_next() {
+    using Traits = std::istream::traits_type;
+    if (Traits::eq_int_type(m_in->peek(), Traits::eof())) return false;
+    m_frame_number = read_uint32(*m_in);
+
+    char row[BYTES_PER_ROW];
+    for (auto spans = read_uint16(*m_in); spans != 0; --spans) {
+        UInt32 begin = read_uint16(*m_in);
+        UInt32 count = read_uint16(*m_in);
+        if (begin + count > UInt32(ErfiGpu::SCREEN_HEIGHT))
+            throw Error("Frame recording has rows off the screen.");
+        for (UInt32 y = begin; y != begin + count; ++y) {
+            if (!read_bytes(*m_in, row, BYTES_PER_ROW))
+                throw make_truncated_error();
+            for (std::size_t w = 0; w != std::size_t(WORDS_PER_ROW); ++w) {
+                VideoWord word = 0;
+                for (std::size_t b = 0; b != 8; ++b)
+                    word = (word << 8) | VideoWord(UInt8(row[w*8 + b]));
+                m_screen[y*std::size_t(WORDS_PER_ROW) + w] = word;
+            }
+        }
+    }
+    return true;
+}
+
+} // end of erfin namespace
+
+namespace {
+
+void push_uint16(std::vector<char> & buffer, UInt16 value) {
+    buffer.push_back(char(value & 0xFF));
+    buffer.push_back(char(value >> 8));
+}
+
+void push_uint32(std::vector<char> & buffer, UInt32 value) {
+    for (int i = 0; i != 4; ++i, value >>= 8)
+        buffer.push_back(char(value & 0xFF));
+}
+
+void push_rows
+    (std::vector<char> & buffer, const VideoWord * words, std::size_t count)
+{
+    auto pos = buffer.size();
+    buffer.resize(pos + count*BYTES_PER_ROW);
+    char * out = &buffer[pos];
+    for (const auto * end = words + count*WORDS_PER_ROW; words != end; ++words) {
+        // built in a local first, so the compiler need not assume each byte
+        // stored could change the word (it becomes a byte swap)
+        const VideoWord word = *words;
+        char bytes[8];
+        for (int i = 0; i != 8; ++i)
+            bytes[i] = char((word >> (56 - 8*i)) & 0xFF);
+        std::memcpy(out, bytes, sizeof(bytes));
+        out += sizeof(bytes);
+    }
+}
+
+bool read_bytes(std::istream & in, char * dest, std::size_t count) {
+    in.read(dest, std::streamsize(count));
+    return std::size_t(in.gcount()) == count;
+}
+
+UInt16 read_uint16(std::istream & in) {
+    char bytes[2];
+    if (!read_bytes(in, bytes, 2)) throw make_truncated_error();
+    return UInt16(UInt8(bytes[0]) | (UInt8(bytes[1]) << 8));
+}
+
+UInt32 read_uint32(std::istream & in) {
+    char bytes[4];
+    if (!read_bytes(in, bytes, 4)) throw make_truncated_error();
+    UInt32 rv = 0;
+    for (int i = 3; i != -1; --i) rv = (rv << 8) | UInt8(bytes[i]);
+    return rv;
+}
+
+Error make_truncated_error()
+    { return Error("Frame recording ends part way through a frame."); }
+
+} // end of <anonymous> namespace
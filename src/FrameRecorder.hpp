@@ -0,0 +1,140 @@
+/****************************************************************************
+
+    File: FrameRecorder.hpp
+    Author: Andrew Janke
+    License: GPLv3
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*****************************************************************************/
+
+#ifndef MACRO_HEADER_GUARD_ERFINDUNG_FRAME_RECORDER_HPP
+#define MACRO_HEADER_GUARD_ERFINDUNG_FRAME_RECORDER_HPP
+
+#include "ErfiGpu.hpp"
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <iosfwd>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace erfin {
+
+/** @brief Streams every frame shown to a file, written on a background
+ *         thread so the console barely notices.
+ *
+ *  Recording format, all numbers are little endian:
+ *  - header: the eight characters "ERFIFRM1", then the screen's width and
+ *    height as UInt16s
+ *  - then each frame: UInt32 frame number (counting from zero), UInt16
+ *    number of spans, and for each span a UInt16 first row, a UInt16 row
+ *    count, followed by that many rows
+ *
+ *  Rows are one bit per pixel, most significant bit first (the same as a
+ *  PBM's raster). A frame only holds the rows which changed since the frame
+ *  before it, the first frame's are relative to a blank screen.
+ */
+class FrameRecorder {
+public:
+    using VideoMemory = ErfiGpu::VideoMemory;
+    using DamageList  = ErfiGpu::DamageList;
+
+    /** Frames are handed to the writer this many at a time (waking it for
+     *  every frame would cost more than writing it).
+     */
+    static constexpr const std::size_t WRITE_BATCH_SIZE = 8;
+
+    /** Frames recorded but not yet written, recording blocks beyond this. */
+    static constexpr const std::size_t MAX_PENDING_FRAMES = 4*WRITE_BATCH_SIZE;
+
+    /** Writes the header straight away, the stream must outlive the
+     *  recorder.
+     */
+    explicit FrameRecorder(std::ostream &);
+    FrameRecorder(const FrameRecorder &) = delete;
+    FrameRecorder & operator = (const FrameRecorder &) = delete;
+
+    /** Finishes writing, any error writing is lost (see finish). */
+    ~FrameRecorder();
+
+    /** Queues the screen's damaged rows to be written.
+     *  @throws if writing an earlier frame failed
+     */
+    void record(const VideoMemory & screen, const DamageList & damage);
+
+    /** Waits for every frame queued to be written, and flushes the stream.
+     *  Nothing may be recorded afterward.
+     *  @throws if writing any frame failed
+     */
+    void finish();
+
+    static void run_tests();
+
+private:
+    // the console's thread only copies the damaged rows, the writer encodes
+    // them
+    struct PendingFrame {
+        UInt32 number;
+        DamageList damage;
+        std::vector<ErfiGpu::VideoWord> rows; // every span's, one after another
+    };
+
+    void write_frames();
+
+    void throw_if_failed();
+
+    std::ostream * m_out;
+    UInt32 m_frame_number;
+
+    std::mutex m_mtx;
+    std::condition_variable m_frame_pending;
+    std::condition_variable m_frame_written;
+    std::deque<PendingFrame> m_pending;
+    std::vector<PendingFrame> m_spares; // written frames, kept for their memory
+    bool m_finishing;
+    std::exception_ptr m_error;
+
+    std::thread m_writer;
+};
+
+/** @brief Plays back a recording made by FrameRecorder. */
+class FrameReader {
+public:
+    using VideoMemory = ErfiGpu::VideoMemory;
+
+    /** @throws if the stream does not start with a recording's header */
+    explicit FrameReader(std::istream &);
+
+    /** Applies the next frame to the screen.
+     *  @return false at the end of the recording
+     *  @throws if the frame is malformed or cut short
+     */
+    bool read_next();
+
+    const VideoMemory & screen() const { return m_screen; }
+
+    UInt32 frame_number() const { return m_frame_number; }
+
+private:
+    std::istream * m_in;
+    VideoMemory m_screen;
+    UInt32 m_frame_number;
+};
+
+} // end of erfin namespace
+
+#endif
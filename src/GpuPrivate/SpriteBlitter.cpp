@@ -0,0 +1,747 @@
+/****************************************************************************
+
+    File: SpriteBlitter.cpp
+    Author: Andrew Janke
+    License: GPLv3
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*****************************************************************************/
+
+#include "SpriteBlitter.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <chrono>
+#include <functional>
+#include <stdexcept>
+
+#include <cassert>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || \
+    defined(_M_IX86)
+#   define MACRO_HAS_X86_SIMD
+#   include <immintrin.h>
+#   ifdef MACRO_COMPILER_MSVC
+#       include <intrin.h>
+#   endif
+#endif
+
+// vectorized kernels are compiled for their instruction set, regardless of
+// the flags for the rest of the program
+#if defined(MACRO_COMPILER_GCC) || defined(MACRO_COMPILER_CLANG)
+#   define MACRO_TARGET_SSE2 __attribute__((target("sse2")))
+#   define MACRO_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#   define MACRO_TARGET_SSE2
+#   define MACRO_TARGET_AVX2
+#endif
+
+namespace {
+
+using Error = std::runtime_error;
+using UInt32 = erfin::UInt32;
+using VideoWord = erfin::VideoWord;
+using SpriteMemory = erfin::SpriteMemory;
+using VideoMemory = erfin::ErfiGpu::VideoMemory;
+
+constexpr const UInt32 SIZE_BITS_MASK = 0x7 << 10;
+constexpr const UInt32 WORDS_PER_ROW  = UInt32(erfin::ErfiGpu::WORDS_PER_ROW);
+constexpr const UInt32 SCREEN_WIDTH   = UInt32(erfin::ErfiGpu::SCREEN_WIDTH );
+constexpr const UInt32 SCREEN_HEIGHT  = UInt32(erfin::ErfiGpu::SCREEN_HEIGHT);
+
+// a sprite draw, after clipping at the bottom of the screen
+struct SpriteBlit {
+    VideoWord * row;    // first screen row drawn to
+    UInt32 x;           // always on screen
+    UInt32 rows;
+    UInt32 size;
+    std::size_t offset; // first sprite row, in bits
+};
+
+// sprite row r, left aligned, right is only used by 128x128 sprites
+void fetch_sprite_row
+    (const SpriteMemory & sprites, const SpriteBlit & blit, UInt32 r,
+     VideoWord & left, VideoWord & right);
+
+// xors a word of pixels onto a row of the screen, starting at pixel x,
+// pixels beyond the right edge are dropped
+void xor_row_pixels(VideoWord * row, UInt32 x, VideoWord bits);
+
+void xor_sprite_scalar(const SpriteMemory & sprites, const SpriteBlit & blit);
+
+#ifdef MACRO_HAS_X86_SIMD
+MACRO_TARGET_SSE2
+void xor_sprite_sse2(const SpriteMemory & sprites, const SpriteBlit & blit);
+
+MACRO_TARGET_AVX2
+void xor_sprite_avx2(const SpriteMemory & sprites, const SpriteBlit & blit);
+#endif
+
+bool host_supports(erfin::BlitKernel);
+
+// replaces bit_count bits at the given position with the most significant
+// bits of the given word (the bits may not straddle two words)
+void write_sprite_bits
+    (SpriteMemory & sprites, std::size_t bit_pos, VideoWord bits,
+     UInt32 bit_count);
+
+// 64 bits of source starting at the given bit, words at or past word_count
+// are read as zero
+VideoWord read_source_bits
+    (const UInt32 * source, std::size_t word_count, std::size_t bit_pos);
+
+// the original DRAW implementation, one vector<bool> proxy per pixel, kept
+// only as the benchmark's baseline
+void xor_sprite_per_pixel
+    (std::vector<bool> & pixels, const std::vector<bool> & sprites,
+     UInt32 x, UInt32 y, UInt32 index);
+
+// the original index decoding loops, kept only to check the table against
+UInt32 compute_size_of_sprite_by_loop(UInt32 index);
+
+std::size_t convert_index_to_offset_by_loop(UInt32 index);
+
+bool is_valid_sprite_index_by_loop(UInt32 index);
+
+// ------------------------- sprite index table ------------------------------
+// (constexpr functions must be defined before the table is)
+
+// Index layout: bits 10-12 are the size, 0 for 128x128 up to 4 for 8x8,
+// then one pair of bits picks a quadrant for each level of subdivision, the
+// lowest pair picks the 128x128 cell.
+
+constexpr UInt32 size_bits_of(UInt32 index)
+    { return (index & SIZE_BITS_MASK) >> 10; }
+
+constexpr UInt32 quadrant_offset
+    (UInt32 index, UInt32 levels, UInt32 quad_size)
+{
+    return levels == 0 ? 0 :
+        quad_size*(index & 0x3) +
+        quadrant_offset(index >> 2, levels - 1, quad_size / 4);
+}
+
+constexpr erfin::SpriteIndexInfo make_sprite_index_info(UInt32 index) {
+    return size_bits_of(index) > 4 ?
+        erfin::SpriteIndexInfo { 0, 0, false } :
+        erfin::SpriteIndexInfo {
+            quadrant_offset(index, size_bits_of(index) + 1, 128*128),
+            128u >> size_bits_of(index),
+            // quadrant pairs beyond the size must be zero
+            ((index & 0x3FF) >> (2*(size_bits_of(index) + 1))) == 0
+        };
+}
+
+// C++11 has no std::index_sequence, lists are built by halves to keep the
+// template depth down
+template <std::size_t ... INDICES>
+struct IndexList {};
+
+template <typename Head, typename Tail>
+struct JoinIndexLists;
+
+template <std::size_t ... HEAD, std::size_t ... TAIL>
+struct JoinIndexLists<IndexList<HEAD...>, IndexList<TAIL...>> {
+    using Type = IndexList<HEAD..., (sizeof...(HEAD) + TAIL)...>;
+};
+
+template <std::size_t COUNT>
+struct MakeIndexList {
+    using Type = typename JoinIndexLists<
+        typename MakeIndexList<COUNT / 2>::Type,
+        typename MakeIndexList<COUNT - COUNT / 2>::Type>::Type;
+};
+
+template <>
+struct MakeIndexList<0> { using Type = IndexList<>; };
+
+template <>
+struct MakeIndexList<1> { using Type = IndexList<0>; };
+
+template <std::size_t ... INDICES>
+constexpr std::array<erfin::SpriteIndexInfo, sizeof...(INDICES)>
+    make_sprite_index_table(IndexList<INDICES...>)
+{ return {{ make_sprite_index_info(UInt32(INDICES))... }}; }
+
+} // end of <anonymous> namespace
+
+namespace erfin {
+
+constexpr const std::array<SpriteIndexInfo, (1 << SPRITE_INDEX_BITS)>
+    SPRITE_INDEX_TABLE = make_sprite_index_table
+        (MakeIndexList<(1 << SPRITE_INDEX_BITS)>::Type());
+
+bool blit_kernel_is_supported(BlitKernel kernel) {
+    static const bool supported[] = {
+        host_supports(BlitKernel::SCALAR),
+        host_supports(BlitKernel::SSE2  ),
+        host_supports(BlitKernel::AVX2  )
+    };
+    static_assert(sizeof(supported)/sizeof(bool) == std::size_t(BlitKernel::COUNT),
+                  "Every kernel needs an entry.");
+    assert(kernel != BlitKernel::COUNT);
+    return supported[std::size_t(kernel)];
+}
+
+BlitKernel best_blit_kernel() {
+    static const BlitKernel best = []() {
+        for (auto k : { BlitKernel::AVX2, BlitKernel::SSE2 }) {
+            if (blit_kernel_is_supported(k)) return k;
+        }
+        return BlitKernel::SCALAR;
+    }();
+    return best;
+}
+
+const char * blit_kernel_name(BlitKernel kernel) {
+    switch (kernel) {
+    case BlitKernel::SCALAR: return "scalar";
+    case BlitKernel::SSE2  : return "sse2"  ;
+    case BlitKernel::AVX2  : return "avx2"  ;
+    default: break;
+    }
+    return "<invalid kernel>";
+}
+
+void xor_sprite
+    (BlitKernel kernel, ErfiGpu::VideoMemory & pixels,
+     const SpriteMemory & sprites, UInt32 x, UInt32 y, UInt32 index)
+{
+    assert(blit_kernel_is_supported(kernel));
+    assert(pixels.size() == WORDS_PER_ROW*SCREEN_HEIGHT);
+    if (x >= SCREEN_WIDTH || y >= SCREEN_HEIGHT) return;
+
+    const auto & info = look_up_sprite_index(index);
+    if (info.size == 0)
+        throw Error("Invalid sprite index: invalid size bits...");
+
+    SpriteBlit blit;
+    blit.size   = info.size;
+    blit.offset = info.offset;
+    blit.row    = &pixels[std::size_t(y*WORDS_PER_ROW)];
+    blit.x      = x;
+    blit.rows   = std::min(blit.size, SCREEN_HEIGHT - y);
+
+    switch (kernel) {
+    case BlitKernel::SCALAR: xor_sprite_scalar(sprites, blit); return;
+#   ifdef MACRO_HAS_X86_SIMD
+    case BlitKernel::SSE2  : xor_sprite_sse2  (sprites, blit); return;
+    case BlitKernel::AVX2  : xor_sprite_avx2  (sprites, blit); return;
+#   endif
+    default: break;
+    }
+    throw Error("Sprite blit kernel is not available on this platform.");
+}
+
+void draw_tile_map
+    (ErfiGpu::VideoMemory & pixels, const SpriteMemory & sprites,
+     const TileMap & map)
+{
+    assert(map.width != 0 && map.height != 0);
+    assert(map.scroll_x < map.width *TILE_SIZE);
+    assert(map.scroll_y < map.height*TILE_SIZE);
+    assert(pixels.size() == WORDS_PER_ROW*SCREEN_HEIGHT);
+    static_assert(TILE_SIZE*TILE_SIZE == VIDEO_WORD_BITS,
+                  "A tile must be exactly one word of sprite memory.");
+    // one more tile than fits across the screen, for when the scroll is
+    // not on a tile boundary
+    static constexpr const UInt32 TILES_ACROSS = SCREEN_WIDTH / TILE_SIZE + 1;
+    std::array<VideoWord, TILES_ACROSS> tiles;
+    // one line of every tile
+    std::array<UInt8, TILES_ACROSS> bytes;
+
+    const UInt32 shift = map.scroll_x % TILE_SIZE;
+    UInt32 map_y = map.scroll_y;
+    for (UInt32 y = 0; y != SCREEN_HEIGHT; ) {
+        // every screen row up to the next tile row uses the same tiles
+        const UInt32 * map_row = map.tiles + (map_y / TILE_SIZE)*map.width;
+        UInt32 column = map.scroll_x / TILE_SIZE;
+        for (auto & tile : tiles) {
+            UInt32 index = map_row[column];
+            const auto & info = look_up_sprite_index(index);
+            bool is_mini = ErfiGpu::is_valid_sprite_index(index) &&
+                           info.size == TILE_SIZE;
+            tile = is_mini ? sprites[info.offset / VIDEO_WORD_BITS] : 0;
+            if (++column == map.width) column = 0;
+        }
+        const UInt32 first_line = map_y % TILE_SIZE;
+        const UInt32 last_line  =
+            std::min(TILE_SIZE, first_line + (SCREEN_HEIGHT - y));
+        for (UInt32 line = first_line; line != last_line; ++line, ++y) {
+            for (std::size_t i = 0; i != tiles.size(); ++i)
+                bytes[i] = UInt8(tiles[i] >> (VIDEO_WORD_BITS - TILE_SIZE*(line + 1)));
+            VideoWord * row = &pixels[std::size_t(y*WORDS_PER_ROW)];
+            for (UInt32 w = 0; w != WORDS_PER_ROW; ++w) {
+                const UInt8 * word_bytes = &bytes[w*8];
+                VideoWord word = 0;
+                for (int i = 0; i != 8; ++i)
+                    word = (word << 8) | word_bytes[i];
+                // word aligned maps need nothing more
+                if (shift != 0)
+                    word = (word << shift) | (word_bytes[8] >> (8 - shift));
+                row[w] = word;
+            }
+        }
+        map_y += last_line - first_line;
+        if (map_y == map.height*TILE_SIZE) map_y = 0;
+    }
+}
+
+void set_sprite_bit(SpriteMemory & sprites, std::size_t bit_pos, bool value) {
+    assert(bit_pos / VIDEO_WORD_BITS < sprites.size());
+    auto mask = VideoWord(1) << (VIDEO_WORD_BITS - 1 - bit_pos % VIDEO_WORD_BITS);
+    auto & word = sprites[bit_pos / VIDEO_WORD_BITS];
+    word = value ? (word | mask) : (word & ~mask);
+}
+
+void upload_sprite_bits
+    (SpriteMemory & sprites, const UInt32 * source, UInt32 width,
+     UInt32 height, UInt32 index)
+{
+    const auto & info = look_up_sprite_index(index);
+    const UInt32 size = info.size;
+    assert(width <= size && height <= size);
+    // no sprite row straddles two words in sprite memory, except for the
+    // largest sprites, whose rows are two whole words
+    std::size_t dest = info.offset;
+    if (width % 32 == 0) {
+        // every source row starts on a word, so words are copied as is
+        for (UInt32 y = 0; y != height; ++y, dest += size) {
+            for (UInt32 x = 0; x != width; x += 32)
+                write_sprite_bits(sprites, dest + x, VideoWord(*source++) << 32, 32);
+        }
+        return;
+    }
+    const std::size_t word_count = (std::size_t(width)*height + 31) / 32;
+    std::size_t source_bit = 0;
+    for (UInt32 y = 0; y != height; ++y, dest += size) {
+        for (UInt32 x = 0; x < width; x += VIDEO_WORD_BITS) {
+            UInt32 bit_count = std::min(VIDEO_WORD_BITS, width - x);
+            write_sprite_bits(sprites, dest + x,
+                read_source_bits(source, word_count, source_bit), bit_count);
+            source_bit += bit_count;
+        }
+    }
+}
+
+VideoWord read_sprite_bits
+    (const SpriteMemory & sprites, std::size_t bit_pos, UInt32 bit_count)
+{
+    assert(bit_count > 0 && bit_count <= VIDEO_WORD_BITS);
+    assert(bit_pos % VIDEO_WORD_BITS + bit_count <= VIDEO_WORD_BITS);
+    assert(bit_pos / VIDEO_WORD_BITS < sprites.size());
+    VideoWord word = sprites[bit_pos / VIDEO_WORD_BITS] << (bit_pos % VIDEO_WORD_BITS);
+    if (bit_count == VIDEO_WORD_BITS) return word;
+    return word & ~(~VideoWord(0) >> bit_count);
+}
+
+UInt32 compute_size_of_sprite(UInt32 index) {
+    auto size = look_up_sprite_index(index).size;
+    if (size == 0)
+        throw Error("Invalid sprite index: invalid size bits...");
+    return size;
+}
+
+std::size_t convert_index_to_offset(UInt32 index)
+    { return look_up_sprite_index(index).offset; }
+
+void run_blit_benchmark(std::ostream & out) {
+    using Clock = std::chrono::steady_clock;
+    using Seconds = std::chrono::duration<double>;
+    static const char * const SIZE_NAMES[] =
+        { "mega", "large", "medium", "small", "mini" };
+    struct Draw { UInt32 x, y, index; };
+
+    std::mt19937 rng(0xB11E);
+    SpriteMemory sprites(SPRITE_MEMORY_BITS / VIDEO_WORD_BITS);
+    for (auto & word : sprites)
+        word = (VideoWord(rng()) << 32) | VideoWord(rng());
+    std::vector<bool> sprite_bits(SPRITE_MEMORY_BITS);
+    for (std::size_t i = 0; i != sprite_bits.size(); ++i)
+        sprite_bits[i] = read_sprite_bits(sprites, i, 1) != 0;
+
+    VideoMemory pixels(WORDS_PER_ROW*SCREEN_HEIGHT, 0);
+    std::vector<bool> pixel_bits(SCREEN_WIDTH*SCREEN_HEIGHT, false);
+
+    out << "Sprites drawn per second (millions)\n" << std::fixed
+        << std::setprecision(3);
+    for (UInt32 size_bits = 0; size_bits != 5; ++size_bits) {
+        const UInt32 size = 128 >> size_bits;
+        std::vector<Draw> draws(1024);
+        for (auto & draw : draws) {
+            draw.x = UInt32(rng()) % SCREEN_WIDTH ;
+            draw.y = UInt32(rng()) % SCREEN_HEIGHT;
+            draw.index = (size_bits << 10) |
+                         (UInt32(rng()) & ((1u << (2*(size_bits + 1))) - 1));
+        }
+        // roughly the same number of pixels for each size
+        const std::size_t draw_count = (std::size_t(1) << 26) / (size*size);
+        auto time_draws = [&](const char * name, std::function<void(const Draw &)> f) {
+            auto start = Clock::now();
+            for (std::size_t i = 0; i != draw_count; ++i)
+                f(draws[i % draws.size()]);
+            double et = Seconds(Clock::now() - start).count();
+            out << std::setw(6) << SIZE_NAMES[size_bits] << " (" << std::setw(3)
+                << size << "x" << std::setw(3) << size << ") "
+                << std::setw(9) << name << ": "
+                << std::setw(10) << (double(draw_count) / et) / 1e6 << "\n";
+        };
+        time_draws("per-pixel", [&](const Draw & d)
+            { xor_sprite_per_pixel(pixel_bits, sprite_bits, d.x, d.y, d.index); });
+        for (auto k : { BlitKernel::SCALAR, BlitKernel::SSE2, BlitKernel::AVX2 }) {
+            if (!blit_kernel_is_supported(k)) continue;
+            time_draws(blit_kernel_name(k), [&](const Draw & d)
+                { xor_sprite(k, pixels, sprites, d.x, d.y, d.index); });
+        }
+    }
+    out.flush();
+    // keeps the draws from being optimized away
+    volatile bool sink = pixels[0] != 0 && pixel_bits[0];
+    (void)sink;
+}
+
+void run_sprite_blitter_tests() {
+    // every kernel must match drawing one pixel at a time, for every
+    // sprite size, including sprites clipped by the edges of the screen
+    std::mt19937 rng(0x5EED);
+    SpriteMemory sprites(SPRITE_MEMORY_BITS / VIDEO_WORD_BITS);
+    for (auto & word : sprites)
+        word = (VideoWord(rng()) << 32) | VideoWord(rng());
+    std::vector<bool> sprite_bits(SPRITE_MEMORY_BITS);
+    for (std::size_t i = 0; i != sprite_bits.size(); ++i)
+        sprite_bits[i] = read_sprite_bits(sprites, i, 1) != 0;
+
+    const UInt32 positions[][2] = {
+        { 0, 0 }, { 1, 1 }, { 63, 5 }, { 64, 7 }, { 100, 100 },
+        { 250, 10 }, { 255, 30 }, { 300, 200 }, { 319, 239 }, { 320, 0 },
+        { 0, 240 }, { 0xFFFFFFF0, 0 }
+    };
+    for (auto k : { BlitKernel::SCALAR, BlitKernel::SSE2, BlitKernel::AVX2 }) {
+        if (!blit_kernel_is_supported(k)) continue;
+        VideoMemory pixels(WORDS_PER_ROW*SCREEN_HEIGHT, 0);
+        std::vector<bool> expected(SCREEN_WIDTH*SCREEN_HEIGHT, false);
+        for (UInt32 size_bits = 0; size_bits != 5; ++size_bits) {
+        for (const auto & pos : positions) {
+            // random quadrants, only as many as the size uses
+            UInt32 index = (size_bits << 10) |
+                (UInt32(rng()) & ((1u << (2*(size_bits + 1))) - 1));
+            assert(ErfiGpu::is_valid_sprite_index(index));
+            xor_sprite(k, pixels, sprites, pos[0], pos[1], index);
+            xor_sprite_per_pixel(expected, sprite_bits, pos[0], pos[1], index);
+            for (UInt32 y = 0; y != SCREEN_HEIGHT; ++y) {
+            for (UInt32 x = 0; x != SCREEN_WIDTH ; ++x) {
+                assert(ErfiGpu::pixel_at(pixels, int(x), int(y)) ==
+                       expected[std::size_t(x + y*SCREEN_WIDTH)]);
+            }}
+        }}
+    }
+    // sprite bits are written most significant bit first
+    {
+    SpriteMemory one_word(1, 0);
+    set_sprite_bit(one_word, 0, true);
+    set_sprite_bit(one_word, 63, true);
+    assert(one_word[0] == 0x8000000000000001ull);
+    set_sprite_bit(one_word, 0, false);
+    assert(read_sprite_bits(one_word, 56, 8) == (VideoWord(1) << 56));
+    }
+    assert(blit_kernel_is_supported(best_blit_kernel()));
+
+    // uploads must match copying one bit at a time, for odd widths, widths
+    // which are whole source words, and everything in between
+    const UInt32 widths[] = { 1, 5, 8, 13, 31, 32, 33, 63, 64, 65, 96, 100, 128 };
+    std::vector<UInt32> source(128*128 / 32);
+    for (auto & word : source) word = UInt32(rng());
+    for (UInt32 size_bits = 0; size_bits != 5; ++size_bits) {
+    for (UInt32 width : widths) {
+        const UInt32 size = 128 >> size_bits;
+        if (width > size) continue;
+        UInt32 height = std::max(UInt32(1), UInt32(rng()) % size);
+        UInt32 index  = (size_bits << 10) |
+            (UInt32(rng()) & ((1u << (2*(size_bits + 1))) - 1));
+        SpriteMemory uploaded = sprites, expected = sprites;
+        upload_sprite_bits(uploaded, source.data(), width, height, index);
+        auto dest = convert_index_to_offset(index);
+        for (UInt32 i = 0; i != width*height; ++i) {
+            bool bit = ((source[i / 32] >> (31 - i % 32)) & 1) != 0;
+            set_sprite_bit(expected, dest + (i / width)*size + i % width, bit);
+        }
+        assert(uploaded == expected);
+    }}
+
+    // the table must agree with the old decoding loops for every encoding
+    // (offsets of indices with invalid size bits are meaningless)
+    for (UInt32 index = 0; index != (1 << SPRITE_INDEX_BITS); ++index) {
+        const auto & info = look_up_sprite_index(index);
+        assert(info.valid == is_valid_sprite_index_by_loop(index));
+        assert(info.valid == ErfiGpu::is_valid_sprite_index(index));
+        try {
+            assert(info.size   == compute_size_of_sprite_by_loop (index));
+            assert(info.offset == convert_index_to_offset_by_loop(index));
+        } catch (std::exception &) {
+            assert(info.size == 0 && !info.valid);
+        }
+        // bits above the index are ignored, but make it invalid
+        assert(&look_up_sprite_index(index | (1 << SPRITE_INDEX_BITS)) == &info);
+        assert(!ErfiGpu::is_valid_sprite_index(index | (1 << SPRITE_INDEX_BITS)));
+        (void)info;
+    }
+}
+
+} // end of erfin namespace
+
+namespace {
+
+void fetch_sprite_row
+    (const SpriteMemory & sprites, const SpriteBlit & blit, UInt32 r,
+     VideoWord & left, VideoWord & right)
+{
+    using namespace erfin;
+    // smaller sprites' rows never straddle a word (every row starts at a
+    // multiple of the sprite's size), the largest are two whole words
+    std::size_t bit_pos = blit.offset + std::size_t(r)*blit.size;
+    if (blit.size > VIDEO_WORD_BITS) {
+        left  = sprites[bit_pos / VIDEO_WORD_BITS    ];
+        right = sprites[bit_pos / VIDEO_WORD_BITS + 1];
+    } else {
+        left  = read_sprite_bits(sprites, bit_pos, blit.size);
+        right = 0;
+    }
+}
+
+void xor_row_pixels(VideoWord * row, UInt32 x, VideoWord bits) {
+    using erfin::VIDEO_WORD_BITS;
+    UInt32 word_index = x / VIDEO_WORD_BITS;
+    UInt32 shift      = x % VIDEO_WORD_BITS;
+    if (word_index >= WORDS_PER_ROW) return;
+    row[word_index] ^= bits >> shift;
+    if (shift != 0 && word_index + 1 < WORDS_PER_ROW)
+        row[word_index + 1] ^= bits << (VIDEO_WORD_BITS - shift);
+}
+
+void xor_sprite_scalar(const SpriteMemory & sprites, const SpriteBlit & blit) {
+    using erfin::VIDEO_WORD_BITS;
+    VideoWord * row = blit.row;
+    for (UInt32 r = 0; r != blit.rows; ++r, row += WORDS_PER_ROW) {
+        VideoWord left, right;
+        fetch_sprite_row(sprites, blit, r, left, right);
+        xor_row_pixels(row, blit.x, left);
+        if (blit.size > VIDEO_WORD_BITS)
+            xor_row_pixels(row, blit.x + VIDEO_WORD_BITS, right);
+    }
+}
+
+#ifdef MACRO_HAS_X86_SIMD
+
+// A sprite row (up to two words) is shifted right by the pixel offset
+// within a word, giving up to three words of output:
+// [left >> s, (left << 64 - s) ^ (right >> s), right << 64 - s]
+// shifts by 64 are zero, so there is no special case for aligned draws
+
+MACRO_TARGET_SSE2
+void xor_sprite_sse2(const SpriteMemory & sprites, const SpriteBlit & blit) {
+    using erfin::VIDEO_WORD_BITS;
+    const UInt32 word_index = blit.x / VIDEO_WORD_BITS;
+    const UInt32 shift      = blit.x % VIDEO_WORD_BITS;
+    const __m128i shift_right = _mm_cvtsi32_si128(int(shift));
+    const __m128i shift_left  = _mm_cvtsi32_si128(int(VIDEO_WORD_BITS - shift));
+    const bool two_words   = word_index + 1 < WORDS_PER_ROW;
+    const bool third_word  = shift != 0 && word_index + 2 < WORDS_PER_ROW &&
+                             blit.size > VIDEO_WORD_BITS;
+
+    VideoWord * row = blit.row + word_index;
+    for (UInt32 r = 0; r != blit.rows; ++r, row += WORDS_PER_ROW) {
+        VideoWord left, right;
+        fetch_sprite_row(sprites, blit, r, left, right);
+        if (!two_words) {
+            row[0] ^= left >> shift;
+            continue;
+        }
+        __m128i v   = _mm_set_epi64x((long long)right, (long long)left);
+        __m128i hi  = _mm_srl_epi64(v, shift_right);
+        __m128i lo  = _mm_sll_epi64(v, shift_left );
+        __m128i out = _mm_xor_si128(hi, _mm_slli_si128(lo, 8));
+        auto * dest = reinterpret_cast<__m128i *>(row);
+        _mm_storeu_si128(dest, _mm_xor_si128(_mm_loadu_si128(dest), out));
+        if (third_word)
+            row[2] ^= right << (VIDEO_WORD_BITS - shift);
+    }
+}
+
+MACRO_TARGET_AVX2
+void xor_sprite_avx2(const SpriteMemory & sprites, const SpriteBlit & blit) {
+    using erfin::VIDEO_WORD_BITS;
+    const UInt32 word_index = blit.x / VIDEO_WORD_BITS;
+    const UInt32 shift      = blit.x % VIDEO_WORD_BITS;
+    // a row of the largest sprites already fills a 128-bit register, and
+    // rows drawn on the last word only touch one word
+    if (blit.size > VIDEO_WORD_BITS || word_index + 1 >= WORDS_PER_ROW) {
+        xor_sprite_sse2(sprites, blit);
+        return;
+    }
+    // two rows at a time, each row becomes [left >> s, left << 64 - s]
+    const __m256i right_counts = _mm256_set_epi64x
+        (VIDEO_WORD_BITS, shift, VIDEO_WORD_BITS, shift);
+    const __m256i left_counts  = _mm256_set_epi64x
+        (VIDEO_WORD_BITS - shift, VIDEO_WORD_BITS, VIDEO_WORD_BITS - shift,
+         VIDEO_WORD_BITS);
+
+    VideoWord * row = blit.row + word_index;
+    UInt32 r = 0;
+    for (; r + 1 < blit.rows; r += 2, row += 2*WORDS_PER_ROW) {
+        VideoWord first, second, unused;
+        fetch_sprite_row(sprites, blit, r    , first , unused);
+        fetch_sprite_row(sprites, blit, r + 1, second, unused);
+        __m256i v = _mm256_set_epi64x
+            ((long long)second, (long long)second,
+             (long long)first , (long long)first );
+        __m256i out = _mm256_or_si256(_mm256_srlv_epi64(v, right_counts),
+                                      _mm256_sllv_epi64(v, left_counts ));
+        auto * dest = reinterpret_cast<__m128i *>(row);
+        _mm_storeu_si128(dest, _mm_xor_si128
+            (_mm_loadu_si128(dest), _mm256_castsi256_si128(out)));
+        dest = reinterpret_cast<__m128i *>(row + WORDS_PER_ROW);
+        _mm_storeu_si128(dest, _mm_xor_si128
+            (_mm_loadu_si128(dest), _mm256_extracti128_si256(out, 1)));
+    }
+    if (r != blit.rows) {
+        VideoWord last, unused;
+        fetch_sprite_row(sprites, blit, r, last, unused);
+        xor_row_pixels(row - word_index, blit.x, last);
+    }
+}
+
+#endif // ifdef MACRO_HAS_X86_SIMD
+
+void write_sprite_bits
+    (SpriteMemory & sprites, std::size_t bit_pos, VideoWord bits,
+     UInt32 bit_count)
+{
+    using erfin::VIDEO_WORD_BITS;
+    assert(bit_count > 0 && bit_count <= VIDEO_WORD_BITS);
+    assert(bit_pos % VIDEO_WORD_BITS + bit_count <= VIDEO_WORD_BITS);
+    assert(bit_pos / VIDEO_WORD_BITS < sprites.size());
+    const UInt32 shift = bit_pos % VIDEO_WORD_BITS;
+    VideoWord mask = (~VideoWord(0) << (VIDEO_WORD_BITS - bit_count)) >> shift;
+    auto & word = sprites[bit_pos / VIDEO_WORD_BITS];
+    word = (word & ~mask) | ((bits >> shift) & mask);
+}
+
+VideoWord read_source_bits
+    (const UInt32 * source, std::size_t word_count, std::size_t bit_pos)
+{
+    auto word_at = [source, word_count](std::size_t i)
+        { return i < word_count ? VideoWord(source[i]) : VideoWord(0); };
+    const std::size_t first = bit_pos / 32;
+    const UInt32      shift = bit_pos % 32;
+    VideoWord rv = ((word_at(first) << 32) | word_at(first + 1)) << shift;
+    if (shift != 0)
+        rv |= word_at(first + 2) >> (32 - shift);
+    return rv;
+}
+
+bool host_supports(erfin::BlitKernel kernel) {
+    using erfin::BlitKernel;
+    switch (kernel) {
+    case BlitKernel::SCALAR: return true;
+#   if defined(MACRO_HAS_X86_SIMD) && \
+       (defined(MACRO_COMPILER_GCC) || defined(MACRO_COMPILER_CLANG))
+    case BlitKernel::SSE2:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("sse2");
+    case BlitKernel::AVX2:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2");
+#   elif defined(MACRO_HAS_X86_SIMD) && defined(MACRO_COMPILER_MSVC)
+    case BlitKernel::SSE2: {
+        int info[4];
+        __cpuid(info, 1);
+        return (info[3] & (1 << 26)) != 0;
+    }
+    case BlitKernel::AVX2: {
+        int info[4];
+        __cpuid(info, 1);
+        // the OS must also save the upper halves of the registers
+        bool os_saves_ymm = (info[2] & (1 << 27)) != 0 &&
+                            (_xgetbv(0) & 0x6) == 0x6;
+        __cpuid(info, 0);
+        if (info[0] < 7 || !os_saves_ymm) return false;
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 5)) != 0;
+    }
+#   endif
+    default: return false;
+    }
+}
+
+void xor_sprite_per_pixel
+    (std::vector<bool> & pixels, const std::vector<bool> & sprites,
+     UInt32 x_, UInt32 y_, UInt32 index)
+{
+    auto text_size   = erfin::compute_size_of_sprite (index);
+    auto text_offset = erfin::convert_index_to_offset(index);
+    for (UInt32 y = y_; (y - y_) != text_size && y < SCREEN_HEIGHT; ++y) {
+    for (UInt32 x = x_; (x - x_) != text_size && x < SCREEN_WIDTH ; ++x) {
+        std::size_t from_index = std::size_t((x - x_) + (y - y_)*text_size);
+        std::size_t to_index   = std::size_t(x + y*SCREEN_WIDTH);
+        pixels[to_index] = pixels[to_index] ^ sprites[text_offset + from_index];
+    }}
+}
+
+UInt32 compute_size_of_sprite_by_loop(UInt32 index) {
+    // 0 -> mega
+    // 1 -> large
+    // 2 -> medium
+    // 3 -> small
+    // 4 -> mini
+    // size mask, number of bits used to encode which "sprite" to use
+    UInt32 bits_used = (SIZE_BITS_MASK & index) >> 10;
+    if (bits_used > 4)
+        throw Error("Invalid sprite index: invalid size bits...");
+    return 128 >> bits_used;
+}
+
+std::size_t convert_index_to_offset_by_loop(UInt32 index) {
+    std::size_t rv = 0;
+    std::size_t current_quad_size = 128*128; // 14
+    for (UInt32 i = ((index >> 10) & 0x7) + 1; i != 0; --i) {
+        // position in increasing level of specifity
+        rv += current_quad_size*(index & 0x3);
+
+        current_quad_size /= 4; // -2
+        index             >>= 2;
+    }
+    return rv;
+}
+
+bool is_valid_sprite_index_by_loop(UInt32 idx) {
+    switch (SIZE_BITS_MASK & idx) {
+    case 0 << 10: case 1 << 10: case 2 << 10: case 3 << 10: case 4 << 10:
+        break;
+    default: return false;
+    }
+    auto active_quadrant_indicies = (SIZE_BITS_MASK & idx) >> 10;
+    UInt32 temp = idx;
+    for (UInt32 i = 0; i != 5; ++i) {
+        if (i > active_quadrant_indicies) {
+            if ((temp & 0x3) != 0) return false;
+        }
+        temp >>= 2;
+    }
+    return (idx >> 13) == 0;
+}
+
+} // end of <anonymous> namespace
@@ -0,0 +1,135 @@
+/****************************************************************************
+
+    File: SpriteBlitter.hpp
+    Author: Andrew Janke
+    License: GPLv3
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*****************************************************************************/
+
+#ifndef MACRO_HEADER_GUARD_GPU_PRIVATE_SPRITE_BLITTER_HPP
+#define MACRO_HEADER_GUARD_GPU_PRIVATE_SPRITE_BLITTER_HPP
+
+#include "../ErfiGpu.hpp"
+
+#include <array>
+#include <iosfwd>
+
+namespace erfin {
+
+using VideoWord    = ErfiGpu::VideoWord;
+using SpriteMemory = std::vector<VideoWord>;
+
+constexpr const UInt32 VIDEO_WORD_BITS    = ErfiGpu::BITS_PER_VIDEO_WORD;
+constexpr const UInt32 SPRITE_MEMORY_BITS = 128*128*4;
+
+/** Implementations of the DRAW command, every kernel gives exactly the same
+ *  results. Vectorized kernels are only available on x86, and only used if
+ *  the host CPU supports them.
+ */
+enum class BlitKernel { SCALAR, SSE2, AVX2, COUNT };
+
+bool blit_kernel_is_supported(BlitKernel);
+
+/** @return fastest kernel supported by the host, determined once */
+BlitKernel best_blit_kernel();
+
+const char * blit_kernel_name(BlitKernel);
+
+/** XORs a sprite onto the screen at the given location, anything which
+ *  falls off the screen is clipped (one row at a time).
+ */
+void xor_sprite
+    (BlitKernel, ErfiGpu::VideoMemory & pixels, const SpriteMemory & sprites,
+     UInt32 x, UInt32 y, UInt32 index);
+
+inline void xor_sprite
+    (ErfiGpu::VideoMemory & pixels, const SpriteMemory & sprites,
+     UInt32 x, UInt32 y, UInt32 index)
+    { xor_sprite(best_blit_kernel(), pixels, sprites, x, y, index); }
+
+/** Everything DRAW and UPLOAD need from a sprite index, decoded ahead of
+ *  time.
+ */
+struct SpriteIndexInfo {
+    UInt32 offset; // first bit of the sprite cell in sprite memory
+    UInt32 size;   // width and height of the cell, zero if the size bits
+                   // are invalid
+    bool valid;    // properly encoded (see ErfiGpu::is_valid_sprite_index)
+};
+
+constexpr const UInt32 SPRITE_INDEX_BITS = 13;
+
+/** Every 13-bit sprite index, built at compile time. */
+extern const std::array<SpriteIndexInfo, (1 << SPRITE_INDEX_BITS)>
+    SPRITE_INDEX_TABLE;
+
+/** @return decoded index, bits above the thirteenth are ignored (an index
+ *          using them is never valid though)
+ */
+inline const SpriteIndexInfo & look_up_sprite_index(UInt32 index)
+    { return SPRITE_INDEX_TABLE[index & (SPRITE_INDEX_TABLE.size() - 1)]; }
+
+constexpr const UInt32 TILE_SIZE = 8;
+
+/** A background of 8x8 tiles, each a mini sprite index. */
+struct TileMap {
+    const UInt32 * tiles; // row after row
+    UInt32 width;         // in tiles, neither may be zero
+    UInt32 height;
+    UInt32 scroll_x;      // map pixel at the top left of the screen, must
+    UInt32 scroll_y;      // be within the map
+};
+
+/** Overwrites the whole screen with the map, which repeats as needed.
+ *  Tiles which are not valid mini sprite indices are left blank.
+ */
+void draw_tile_map
+    (ErfiGpu::VideoMemory & pixels, const SpriteMemory & sprites,
+     const TileMap & map);
+
+void set_sprite_bit(SpriteMemory & sprites, std::size_t bit_pos, bool value);
+
+/** Copies a width by height sprite into the sprite cell at index. The source
+ *  is packed row after row into 32-bit words, most significant bit first,
+ *  rows are not padded. Bits of the cell outside of the sprite are left
+ *  untouched.
+ *  @param source must hold at least ceil(width*height / 32) words
+ */
+void upload_sprite_bits
+    (SpriteMemory & sprites, const UInt32 * source, UInt32 width,
+     UInt32 height, UInt32 index);
+
+/** @return bit_count bits from the given position, in the most significant
+ *          bits of the word (the bits may not straddle two words)
+ */
+VideoWord read_sprite_bits
+    (const SpriteMemory & sprites, std::size_t bit_pos, UInt32 bit_count);
+
+/** @throws if the size bits of the index are invalid */
+UInt32 compute_size_of_sprite(UInt32 index);
+
+std::size_t convert_index_to_offset(UInt32 index);
+
+/** Prints sprites drawn per second, for each sprite size and each kernel
+ *  the host supports (along with the old one pixel at a time loop).
+ */
+void run_blit_benchmark(std::ostream &);
+
+void run_sprite_blitter_tests();
+
+} // end of erfin namespace
+
+#endif
@@ -0,0 +1,147 @@
+/****************************************************************************
+
+    File: SpscRing.hpp
+    Author: Andrew Janke
+    License: GPLv3
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*****************************************************************************/
+
+#ifndef MACRO_HEADER_GUARD_ERFINDUNG_SPSC_RING_HPP
+#define MACRO_HEADER_GUARD_ERFINDUNG_SPSC_RING_HPP
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+
+#include <cassert>
+#include <cstddef>
+
+namespace erfin {
+
+/** @brief A fixed capacity, lock-free, single producer/single consumer ring
+ *         buffer.
+ *
+ *  One thread may push while another reads and pops, without locks. Nothing
+ *  is ever allocated, pushing onto a full ring fails instead.
+ *
+ *  Positions only ever increase (wrapping at the end of size_t), and are
+ *  masked into the buffer, hence the power of two capacity.
+ */
+template <typename T, std::size_t CAPACITY>
+class SpscRing {
+public:
+    static_assert(CAPACITY != 0 && (CAPACITY & (CAPACITY - 1)) == 0,
+                  "Capacity must be a power of two.");
+
+    static constexpr const std::size_t MASK = CAPACITY - 1;
+
+    /** Elements which are contiguous in the buffer. */
+    struct Span {
+        const T * data;
+        std::size_t size;
+    };
+
+    SpscRing(): m_read(0), m_write(0) {}
+    SpscRing(const SpscRing &) = delete;
+    SpscRing & operator = (const SpscRing &) = delete;
+
+    // ------------------------------ producer --------------------------------
+
+    /** @return false (and drops the element) if the ring is full */
+    bool push(const T & value) {
+        auto write = m_write.load(std::memory_order_relaxed);
+        if (write - m_read.load(std::memory_order_acquire) == CAPACITY)
+            return false;
+        m_buffer[write & MASK] = value;
+        m_write.store(write + 1, std::memory_order_release);
+        return true;
+    }
+
+    /** Pushes as many elements as there is room for, from the front.
+     *  @return number of elements pushed
+     */
+    std::size_t push(const T * values, std::size_t count) {
+        auto write = m_write.load(std::memory_order_relaxed);
+        count = std::min(count, CAPACITY - (write - m_read.load(std::memory_order_acquire)));
+        auto to_end = std::min(count, CAPACITY - (write & MASK));
+        std::copy(values, values + to_end, &m_buffer[write & MASK]);
+        std::copy(values + to_end, values + count, &m_buffer[0]);
+        m_write.store(write + count, std::memory_order_release);
+        return count;
+    }
+
+    /** @return number of elements which may be pushed right now */
+    std::size_t room() const {
+        return CAPACITY - (m_write.load(std::memory_order_relaxed) -
+                           m_read .load(std::memory_order_acquire));
+    }
+
+    // ------------------------------ consumer --------------------------------
+
+    std::size_t size() const {
+        return m_write.load(std::memory_order_acquire) -
+               m_read .load(std::memory_order_relaxed);
+    }
+
+    bool empty() const { return size() == 0; }
+
+    /** @return i-th element from the front, which must be available */
+    const T & peek(std::size_t i = 0) const {
+        assert(i < size());
+        return m_buffer[(m_read.load(std::memory_order_relaxed) + i) & MASK];
+    }
+
+    /** @return every available element up to the end of the buffer, the
+     *          rest (if any) follows at the start of the buffer, and is in
+     *          the next span after these are popped
+     */
+    Span front_span() const {
+        auto read = m_read.load(std::memory_order_relaxed);
+        auto available = m_write.load(std::memory_order_acquire) - read;
+        auto to_end = CAPACITY - (read & MASK);
+        return Span { &m_buffer[read & MASK],
+                      available < to_end ? available : to_end };
+    }
+
+    void pop(std::size_t count = 1) {
+        assert(count <= size());
+        m_read.store(m_read.load(std::memory_order_relaxed) + count,
+                     std::memory_order_release);
+    }
+
+    void clear() { pop(size()); }
+
+private:
+    using Position = std::atomic<std::size_t>;
+    // each is written by only one thread, so they are kept a cache line
+    // apart (padded rather than aligned, C++11's new ignores over alignment)
+    static constexpr const std::size_t CACHE_LINE_SIZE = 64;
+
+    Position m_read;
+    char m_padding[CACHE_LINE_SIZE - sizeof(Position)];
+    Position m_write;
+    std::array<T, CAPACITY> m_buffer;
+};
+
+template <typename T, std::size_t CAPACITY>
+constexpr /* static */ const std::size_t SpscRing<T, CAPACITY>::MASK;
+
+template <typename T, std::size_t CAPACITY>
+constexpr /* static */ const std::size_t SpscRing<T, CAPACITY>::CACHE_LINE_SIZE;
+
+} // end of erfin namespace
+
+#endif
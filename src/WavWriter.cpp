@@ -0,0 +1,284 @@
+/****************************************************************************
+
+    File: WavWriter.cpp
+    Author: Andrew Janke
+    License: GPLv3
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*****************************************************************************/
+
+#include "WavWriter.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+#include <cassert>
+
+namespace {
+
+using Error  = std::runtime_error;
+using Int16  = erfin::WavWriter::Int16;
+using UInt16 = erfin::UInt16;
+using UInt32 = erfin::UInt32;
+
+constexpr const std::size_t HEADER_SIZE     = 44;
+constexpr const unsigned    BITS_PER_SAMPLE = 16;
+
+// RIFF header for the given number of samples, every number is little
+// endian
+std::vector<char> make_header
+    (unsigned channel_count, unsigned sample_rate, UInt32 data_size);
+
+void push_uint16(std::vector<char> & buffer, UInt16 value);
+
+void push_uint32(std::vector<char> & buffer, UInt32 value);
+
+void push_tag(std::vector<char> & buffer, const char * tag);
+
+UInt32 read_uint32(const std::string & bytes, std::size_t at);
+
+} // end of <anonymous> namespace
+
+namespace erfin {
+
+constexpr /* static */ const std::size_t WavWriter::BUFFER_SIZE;
+
+WavWriter::WavWriter
+    (std::ostream & out, unsigned channel_count, unsigned sample_rate):
+    m_out(&out),
+    m_header_position(out.tellp()),
+    m_sample_count(0),
+    m_finishing(false)
+{
+    // sizes are filled in by finish
+    auto header = make_header(channel_count, sample_rate, 0);
+    out.write(header.data(), std::streamsize(header.size()));
+    if (!out || m_header_position == std::streampos(-1))
+        throw Error("Failed to write the WAV header (the file must be seekable).");
+    m_filling.reserve(BUFFER_SIZE);
+    m_pending.reserve(BUFFER_SIZE);
+    std::thread writer(&WavWriter::write_buffers, this);
+    m_writer.swap(writer);
+}
+
+WavWriter::~WavWriter() {
+    try {
+        finish();
+    } catch (...) {
+        // only finish reports errors
+    }
+}
+
+void WavWriter::write(const Int16 * samples, std::size_t count) {
+    assert(!m_finishing);
+    m_sample_count += count;
+    while (count != 0) {
+        auto to_copy = std::min(count, BUFFER_SIZE - m_filling.size());
+        m_filling.insert(m_filling.end(), samples, samples + to_copy);
+        samples += to_copy;
+        count   -= to_copy;
+        if (m_filling.size() == BUFFER_SIZE) hand_off_buffer();
+    }
+}
+
+void WavWriter::finish() {
+    if (m_writer.joinable()) {
+        if (!m_filling.empty()) {
+            try {
+                hand_off_buffer();
+            } catch (...) {
+                // reported below, once the writer is done
+            }
+        }
+        {
+        std::unique_lock<std::mutex> lock(m_mtx);
+        m_finishing = true;
+        }
+        m_buffer_ready.notify_one();
+        m_writer.join();
+
+        static constexpr const std::size_t MAX_DATA_SIZE =
+            std::numeric_limits<UInt32>::max() - HEADER_SIZE;
+        auto data_size = m_sample_count*sizeof(Int16);
+        if (!m_error && data_size > MAX_DATA_SIZE)
+            m_error = std::make_exception_ptr(Error("Too much audio for a WAV file."));
+        if (!m_error) {
+            // the header made at the start has every size as zero
+            std::vector<char> sizes;
+            push_uint32(sizes, UInt32(HEADER_SIZE - 8 + data_size));
+            m_out->seekp(m_header_position + std::streamoff(4));
+            m_out->write(sizes.data(), 4);
+            sizes.clear();
+            push_uint32(sizes, UInt32(data_size));
+            m_out->seekp(m_header_position + std::streamoff(HEADER_SIZE - 4));
+            m_out->write(sizes.data(), 4);
+            m_out->seekp(0, std::ios_base::end);
+            if (!m_out->flush())
+                m_error = std::make_exception_ptr(Error("Failed to finish writing the WAV file."));
+        }
+    }
+    throw_if_failed();
+}
+
+/* static */ void WavWriter::run_tests() {
+    // samples are written whole and in order, across several buffers, with
+    // the header describing them
+    {
+    std::vector<Int16> samples(BUFFER_SIZE*2 + 6);
+    for (std::size_t i = 0; i != samples.size(); ++i)
+        samples[i] = Int16(i*7919);
+    std::stringstream wav;
+    {
+    WavWriter writer(wav, 2, 11025);
+    writer.write(samples.data(), 6);
+    writer.write(samples.data() + 6, samples.size() - 6);
+    assert(writer.sample_count() == samples.size());
+    writer.finish();
+    }
+    auto bytes = wav.str();
+    const auto data_size = samples.size()*2;
+    assert(bytes.size() == HEADER_SIZE + data_size);
+    assert(bytes.compare(0, 4, "RIFF") == 0 && bytes.compare(8, 8, "WAVEfmt ") == 0);
+    assert(read_uint32(bytes, 4) == HEADER_SIZE - 8 + data_size);
+    assert(read_uint32(bytes, 24) == 11025);
+    assert(read_uint32(bytes, 28) == 11025*2*2); // bytes per second
+    assert(bytes.compare(36, 4, "data") == 0);
+    assert(read_uint32(bytes, 40) == data_size);
+    for (std::size_t i = 0; i != samples.size(); ++i) {
+        auto lo = UInt16(UInt8(bytes[HEADER_SIZE + i*2]));
+        auto hi = UInt16(UInt8(bytes[HEADER_SIZE + i*2 + 1]));
+        assert(Int16(lo | (hi << 8)) == samples[i]);
+        (void)lo; (void)hi;
+    }
+    }
+    // errors writing are reported
+    {
+    std::stringstream broken;
+    WavWriter writer(broken, 1, 8000);
+    broken.setstate(std::ios_base::badbit);
+    std::vector<Int16> samples(BUFFER_SIZE, 1);
+    bool threw = false;
+    try {
+        writer.write(samples);
+        writer.write(samples);
+        writer.finish();
+    } catch (std::exception &) {
+        threw = true;
+    }
+    assert(threw);
+    (void)threw;
+    }
+}
+
+/* private */ void WavWriter::write_buffers() {
+    std::vector<Int16> samples;
+    std::vector<char> bytes;
+    bytes.reserve(BUFFER_SIZE*sizeof(Int16));
+    while (true) {
+        {
+        std::unique_lock<std::mutex> lock(m_mtx);
+        m_buffer_ready.wait(lock, [this]()
+            { return !m_pending.empty() || m_finishing; });
+        if (m_pending.empty()) return;
+        samples.swap(m_pending);
+        }
+        m_buffer_written.notify_one();
+
+        // a byte at a time, so the file does not depend on the host's byte
+        // order
+        bytes.resize(samples.size()*sizeof(Int16));
+        char * out = bytes.data();
+        for (auto sample : samples) {
+            *out++ = char(UInt16(sample) & 0xFF);
+            *out++ = char(UInt16(sample) >> 8);
+        }
+        samples.clear();
+        m_out->write(bytes.data(), std::streamsize(bytes.size()));
+        if (!*m_out) {
+            std::unique_lock<std::mutex> lock(m_mtx);
+            m_error = std::make_exception_ptr(Error("Failed to write to the WAV file."));
+            m_buffer_written.notify_one();
+            return;
+        }
+    }
+}
+
+/* private */ void WavWriter::hand_off_buffer() {
+    {
+    std::unique_lock<std::mutex> lock(m_mtx);
+    m_buffer_written.wait(lock, [this]()
+        { return m_pending.empty() || m_error; });
+    throw_if_failed();
+    m_pending.swap(m_filling);
+    }
+    m_buffer_ready.notify_one();
+    m_filling.clear();
+}
+
+/* private */ void WavWriter::throw_if_failed() {
+    if (m_error) std::rethrow_exception(m_error);
+}
+
+} // end of erfin namespace
+
+namespace {
+
+std::vector<char> make_header
+    (unsigned channel_count, unsigned sample_rate, UInt32 data_size)
+{
+    const auto block_align = UInt16(channel_count*BITS_PER_SAMPLE / 8);
+    std::vector<char> header;
+    push_tag   (header, "RIFF");
+    push_uint32(header, UInt32(HEADER_SIZE - 8) + data_size);
+    push_tag   (header, "WAVE");
+    push_tag   (header, "fmt ");
+    push_uint32(header, 16); // size of the rest of this chunk
+    push_uint16(header, 1 ); // integer PCM
+    push_uint16(header, UInt16(channel_count));
+    push_uint32(header, sample_rate);
+    push_uint32(header, sample_rate*block_align);
+    push_uint16(header, block_align);
+    push_uint16(header, BITS_PER_SAMPLE);
+    push_tag   (header, "data");
+    push_uint32(header, data_size);
+    assert(header.size() == HEADER_SIZE);
+    return header;
+}
+
+void push_uint16(std::vector<char> & buffer, UInt16 value) {
+    buffer.push_back(char(value & 0xFF));
+    buffer.push_back(char(value >> 8  ));
+}
+
+void push_uint32(std::vector<char> & buffer, UInt32 value) {
+    push_uint16(buffer, UInt16(value & 0xFFFF));
+    push_uint16(buffer, UInt16(value >> 16   ));
+}
+
+void push_tag(std::vector<char> & buffer, const char * tag) {
+    buffer.insert(buffer.end(), tag, tag + 4);
+}
+
+UInt32 read_uint32(const std::string & bytes, std::size_t at) {
+    UInt32 rv = 0;
+    for (std::size_t i = 0; i != 4; ++i)
+        rv |= UInt32(erfin::UInt8(bytes[at + i])) << (i*8);
+    return rv;
+}
+
+} // end of <anonymous> namespace
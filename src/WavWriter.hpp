@@ -0,0 +1,105 @@
+/****************************************************************************
+
+    File: WavWriter.hpp
+    Author: Andrew Janke
+    License: GPLv3
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*****************************************************************************/
+
+#ifndef MACRO_HEADER_GUARD_ERFINDUNG_WAV_WRITER_HPP
+#define MACRO_HEADER_GUARD_ERFINDUNG_WAV_WRITER_HPP
+
+#include "ErfiDefs.hpp"
+
+#include <condition_variable>
+#include <exception>
+#include <iosfwd>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <cstdint>
+
+namespace erfin {
+
+/** @brief Streams 16-bit PCM samples to a WAV file, written on a background
+ *         thread.
+ *
+ *  Samples are gathered into a buffer on the caller's thread, and a full
+ *  buffer is handed to the writer while the next one fills. The header's
+ *  sizes are only known at the end, so the stream must be seekable.
+ */
+class WavWriter {
+public:
+    using Int16 = std::int16_t;
+
+    /** Samples (over every channel) handed to the writer at a time. */
+    static constexpr const std::size_t BUFFER_SIZE = 1 << 16;
+
+    /** Writes a header straight away, the stream must outlive the writer. */
+    WavWriter(std::ostream &, unsigned channel_count, unsigned sample_rate);
+    WavWriter(const WavWriter &) = delete;
+    WavWriter & operator = (const WavWriter &) = delete;
+
+    /** Finishes writing, any error writing is lost (see finish). */
+    ~WavWriter();
+
+    /** Queues interleaved samples to be written, count should be a whole
+     *  number of frames (one sample per channel).
+     *  @throws if writing earlier samples failed
+     */
+    void write(const Int16 * samples, std::size_t count);
+
+    void write(const std::vector<Int16> & samples)
+        { write(samples.data(), samples.size()); }
+
+    /** Writes everything queued, fills in the header's sizes and flushes.
+     *  Nothing may be written afterward.
+     *  @throws if writing failed, or the file grew too large for a WAV
+     */
+    void finish();
+
+    /** @return samples queued since the writer was made */
+    std::size_t sample_count() const { return m_sample_count; }
+
+    static void run_tests();
+
+private:
+    void write_buffers();
+
+    // hands the filling buffer to the writer, waiting if it is busy
+    void hand_off_buffer();
+
+    void throw_if_failed();
+
+    std::ostream * m_out;
+    std::streampos m_header_position;
+    std::size_t m_sample_count;
+    std::vector<Int16> m_filling;
+
+    std::mutex m_mtx;
+    std::condition_variable m_buffer_ready;
+    std::condition_variable m_buffer_written;
+    std::vector<Int16> m_pending; // empty while the writer is free
+    bool m_finishing;
+    std::exception_ptr m_error;
+
+    std::thread m_writer;
+};
+
+} // end of erfin namespace
+
+#endif
@@ -20,6 +20,7 @@
 *****************************************************************************/
 
 #include <iostream>
+#include <fstream>
 #include <cassert>
 
 #ifndef MACRO_BUILD_STL_ONLY
@@ -30,6 +31,11 @@
 #include "Debugger.hpp"
 #include "Assembler.hpp"
 #include "ErfiConsole.hpp"
+#include "BatchRunner.hpp"
+#include "FrameRecorder.hpp"
+#include "WavWriter.hpp"
+#include "FixedPointUtil.hpp"
+#include "GpuPrivate/SpriteBlitter.hpp"
 
 #include "tests.hpp"
 #include "parse_program_options.hpp"
@@ -80,6 +86,53 @@ constexpr const char * const HELP_TEXT =
     "Prints current frame at the given line numbers to the terminal. "
     "Lists registers and their values, and continues running the "
     "program. Invalid line numbers are ignored.\n"
+    "-d / --dispatch\n"
+    "Selects how the CPU dispatches instructions, either \"switch\"\n"
+    "or \"threaded\" (the default). Only affects unwatched and batch\n"
+    "runs.\n"
+    "-v / --virtual-time\n"
+    "Runs the console on virtual time, each frame takes exactly 1/n\n"
+    "seconds as far as the program can tell, where n is the optional\n"
+    "argument (default 60). Command line runs then no longer wait for\n"
+    "the wall clock between frames.\n"
+    "-e / --seed\n"
+    "Seeds the console's random number generator with the given base 10\n"
+    "integer, rather than a random seed. Used with --virtual-time a\n"
+    "program runs the same way every time.\n"
+    "-m / --batch\n"
+    "Runs each of the given source files headlessly in its own console,\n"
+    "several at a time, and reports instruction counts, frames and\n"
+    "errors per program. Batch runs are always on virtual time (see\n"
+    "--virtual-time) and use the same seed for every program (zero,\n"
+    "unless --seed is given). Not compatible with -i/-r.\n"
+    "-j / --jobs\n"
+    "Number of worker threads used for batch runs (defaults to one per\n"
+    "hardware thread).\n"
+    "-f / --frame-limit\n"
+    "Number of frames a batch run program (or an audio render) may run\n"
+    "for before being stopped (default 3600).\n"
+    "-g / --golden-frames\n"
+    "Hashes the screen after every frame of a batch run, and checks the\n"
+    "hashes against the given file of golden frames, reporting the first\n"
+    "frame each program differs on.\n"
+    "-u / --update-golden\n"
+    "Writes the batch run's hashes to the --golden-frames file instead\n"
+    "of checking them.\n"
+    "-k / --blit-benchmark\n"
+    "Times drawing sprites of each size with every blitter the host\n"
+    "supports, against the old one pixel at a time loop, and prints\n"
+    "sprites drawn per second.\n"
+    "-o / --record\n"
+    "Records every frame shown to the given file, one bit per pixel,\n"
+    "storing only the rows which changed each frame. The file is\n"
+    "written on a background thread (FrameRecorder.hpp describes the\n"
+    "format).\n"
+    "-a / --render-audio\n"
+    "Runs the program without a window on virtual time (see\n"
+    "--virtual-time), as fast as the host allows, and writes everything\n"
+    "the APU plays to the given WAV file instead (one channel for each\n"
+    "of the APU's). Stops when the program halts, or after --frame-limit\n"
+    "frames.\n"
     "-w -watch\n"
     "Implicitly enabled with breakpoints. Watch mode accepts one numeric\n"
     "argument n, for the number of frames to keep in run history. Run \n"
@@ -146,6 +199,24 @@ private:
     std::vector<erfin::DebuggerFrame> m_frames;
 };
 
+// the file given to --record, and its writer
+class Recording {
+public:
+    explicit Recording(const std::string & filename);
+
+    void record(const erfin::Console & console)
+        { m_recorder->record(console.current_screen(), console.screen_damage()); }
+
+    void finish() { m_recorder->finish(); }
+
+private:
+    std::ofstream m_file;
+    std::unique_ptr<erfin::FrameRecorder> m_recorder;
+};
+
+// @return nullptr if no recording was asked for
+std::unique_ptr<Recording> start_recording(const ProgramOptions &);
+
 } // end of <anonymous> namespace
 
 int main(int argc, char ** argv) {
@@ -222,6 +293,83 @@ void watched_cli_run
 void print_help(const ProgramOptions &, const ProgramData &)
     { std::cout << HELP_TEXT << std::endl; }
 
+void batch_run(const ProgramOptions & opts, const ProgramData &) {
+    erfin::BatchRunner runner;
+    runner.set_thread_count(opts.batch_jobs);
+    if (opts.virtual_frame_rate)
+        runner.set_frame_rate(opts.virtual_frame_rate);
+    if (opts.has_rng_seed)
+        runner.set_rng_seed(opts.rng_seed);
+    runner.set_frame_limit(opts.batch_frame_limit);
+    runner.set_dispatcher(opts.cpu_dispatcher);
+    for (const auto & filename : opts.batch_inputs)
+        runner.add_program_from_file(filename);
+    runner.set_frame_hashing(!opts.golden_filename.empty());
+    auto results = runner.run();
+    erfin::BatchRunner::print_results(std::cout, results);
+    for (const auto & res : results) {
+        if (res.outcome == erfin::BatchRunner::Outcome::FAILED)
+            throw Error("One or more batch programs failed.");
+    }
+    if (opts.golden_filename.empty()) return;
+    if (opts.update_golden) {
+        std::ofstream fout(opts.golden_filename.c_str());
+        erfin::BatchRunner::write_golden_frames(fout, results);
+        if (!fout)
+            throw Error("Failed to write golden frames to \"" +
+                        opts.golden_filename + "\".");
+        return;
+    }
+    std::ifstream fin(opts.golden_filename.c_str());
+    if (!fin)
+        throw Error("Failed to open golden frames \"" + opts.golden_filename +
+                    "\".");
+    if (erfin::BatchRunner::compare_golden_frames(fin, results, std::cout) != 0)
+        throw Error("Frames differ from the golden frames.");
+}
+
+void blit_benchmark(const ProgramOptions &, const ProgramData &) {
+    std::cout << "Best supported blitter: "
+              << erfin::blit_kernel_name(erfin::best_blit_kernel()) << "\n";
+    erfin::run_blit_benchmark(std::cout);
+}
+
+void render_audio(const ProgramOptions & opts, const ProgramData & program) {
+    using namespace erfin;
+    std::ofstream fout(opts.render_audio_filename.c_str(), std::ofstream::binary);
+    if (!fout) {
+        throw Error("Failed to open \"" + opts.render_audio_filename +
+                    "\" for rendering audio.");
+    }
+    // always on virtual time, so nothing waits on the wall clock
+    auto frame_rate = opts.virtual_frame_rate ?
+        opts.virtual_frame_rate : ProgramOptions::DEFAULT_VIRTUAL_FRAME_RATE;
+    std::unique_ptr<Console> console(new Console());
+    console->set_virtual_time_step(to_fixed_point(1.0 / double(frame_rate)));
+    if (opts.has_rng_seed)
+        console->seed_rng(opts.rng_seed);
+    console->set_cpu_dispatcher(opts.cpu_dispatcher);
+    console->set_audio_device_enabled(false);
+    console->load_program(program);
+
+    WavWriter writer(fout, unsigned(Channel::COUNT), unsigned(Apu::SAMPLE_RATE));
+    std::size_t frames = 0;
+    while (!console->trying_to_shutdown() && frames != opts.batch_frame_limit) {
+        console->run_until_wait();
+        writer.write(console->audio_samples());
+        ++frames;
+    }
+    console->flush_audio();
+    writer.write(console->audio_samples());
+    writer.finish();
+
+    auto sample_frames = writer.sample_count() / std::size_t(Channel::COUNT);
+    std::cout << "Rendered " << frames << " frame(s), "
+              << double(sample_frames) / double(Apu::SAMPLE_RATE)
+              << " second(s) of audio to \"" << opts.render_audio_filename
+              << "\"." << std::endl;
+}
+
 namespace {
 
 ExecutionHistoryLogger::ExecutionHistoryLogger(int frame_limit) noexcept:
@@ -244,6 +392,19 @@ std::string ExecutionHistoryLogger::to_string
     return rv;
 }
 
+Recording::Recording(const std::string & filename):
+    m_file(filename.c_str(), std::ofstream::binary)
+{
+    if (!m_file)
+        throw Error("Failed to open \"" + filename + "\" for recording.");
+    m_recorder.reset(new erfin::FrameRecorder(m_file));
+}
+
+std::unique_ptr<Recording> start_recording(const ProgramOptions & opts) {
+    if (opts.record_filename.empty()) return nullptr;
+    return std::unique_ptr<Recording>(new Recording(opts.record_filename));
+}
+
 } // end of <anonymous> namespace
 
 // ----------------------------------------------------------------------------
@@ -253,12 +414,14 @@ namespace {
 template <typename Func>
 void in_windowed_mode
     (const ProgramOptions & opts, erfin::Console & console,
-     Func && do_between_cycles);
+     Func && run_frame);
 
 template <typename Func>
 void in_terminal_mode
     (const ProgramOptions &, erfin::Console & console,
-     Func && do_between_cycles);
+     Func && run_frame);
+
+void apply_clock_options(const ProgramOptions & opts, erfin::Console & console);
 
 template <decltype (WINDOWED) UI_TYPE>
 void do_watched_mode
@@ -266,6 +429,7 @@ void do_watched_mode
 {
     using namespace erfin;
     Console console;
+    apply_clock_options(opts, console);
     Debugger debugger;
     ExecutionHistoryLogger exlogger(opts.watched_history_length);
     opts.assembler->setup_debugger(debugger);
@@ -279,6 +443,7 @@ void do_watched_mode
         }
     }
 
+    auto recording = start_recording(opts);
     try {
         auto between_cycles = [&]() {
             console.update_with_current_state(debugger);
@@ -287,11 +452,16 @@ void do_watched_mode
                 std::cout << debugger.print_current_frame_to_string() << std::endl;
             }
         };
+        auto run_frame = [&]() {
+            console.run_until_wait_with_post_frame(between_cycles);
+            if (recording) recording->record(console);
+        };
         if (UI_TYPE == WINDOWED) {
-            in_windowed_mode(opts, console, std::move(between_cycles));
+            in_windowed_mode(opts, console, std::move(run_frame));
         } else {
-            in_terminal_mode(opts, console, std::move(between_cycles));
+            in_terminal_mode(opts, console, std::move(run_frame));
         }
+        if (recording) recording->finish();
     } catch (std::exception & exp) {
         throw Error(std::string(exp.what()) +
                     "\nAdditionally the prefail frames are as follows:\n" +
@@ -310,12 +480,20 @@ void do_unwatched_mode
 {
     using namespace erfin;
     Console console;
+    apply_clock_options(opts, console);
+    console.set_cpu_dispatcher(opts.cpu_dispatcher);
     console.load_program(program);
+    auto recording = start_recording(opts);
+    auto run_frame = [&console, &recording]() {
+        console.run_until_wait();
+        if (recording) recording->record(console);
+    };
     if (UI_TYPE == WINDOWED) {
-        in_windowed_mode(opts, console, [](){});
+        in_windowed_mode(opts, console, std::move(run_frame));
     } else {
-        in_terminal_mode(opts, console, [](){});
+        in_terminal_mode(opts, console, std::move(run_frame));
     }
+    if (recording) recording->finish();
 }
 
 } // end of <anonymous> namespace
@@ -330,8 +508,10 @@ void setup_window_view(sf::RenderWindow & window, const ProgramOptions &);
 
 void process_events(erfin::Console & console, sf::Window & window);
 
+// converts only the given rows
 void map_screen_to_texture
-    (const erfin::Console & console, std::vector<erfin::UInt32> & raw_pixels);
+    (const erfin::Console & console, std::vector<erfin::UInt32> & raw_pixels,
+     const erfin::ErfiGpu::RowSpan & rows);
 
 #endif
 
@@ -347,7 +527,7 @@ void print_frame(const erfin::Console & console);
 template <typename Func>
 void in_windowed_mode
     (const ProgramOptions & opts, erfin::Console & console,
-     Func && do_between_cycles)
+     Func && run_frame)
 {
 #   ifndef MACRO_BUILD_STL_ONLY
     using namespace erfin;
@@ -357,11 +537,15 @@ void in_windowed_mode
     int fps = 0;
     int frame_count = 0;
 
+    std::vector<UInt32> pixel_array(SCREEN_HEIGHT*SCREEN_WIDTH, 0);
+    assert(pixel_array.size() ==
+           console.current_screen().size()*ErfiGpu::BITS_PER_VIDEO_WORD);
+
+    // the screen starts blank, after that only rows which changed are
+    // converted and uploaded
     sf::Texture screen_pixels;
     screen_pixels.create(SCREEN_WIDTH, SCREEN_HEIGHT);
-
-    std::vector<UInt32> pixel_array(SCREEN_HEIGHT*SCREEN_WIDTH, 0);
-    assert(pixel_array.size() == console.current_screen().size());
+    screen_pixels.update(reinterpret_cast<UInt8 *>(&pixel_array.front()));
 
     sf::Sprite screen_sprite;
     screen_sprite.setTexture(screen_pixels);
@@ -381,13 +565,16 @@ void in_windowed_mode
 
         window.clear();
 
-        console.run_until_wait_with_post_frame(std::move(do_between_cycles));
+        run_frame();
         if (console.trying_to_shutdown())
             break;
 
-        map_screen_to_texture(console, pixel_array);
-        screen_pixels.update(reinterpret_cast<UInt8 *>(&pixel_array.front()),
-                             SCREEN_WIDTH, SCREEN_HEIGHT, 0, 0);
+        for (const auto & rows : console.screen_damage()) {
+            map_screen_to_texture(console, pixel_array, rows);
+            screen_pixels.update
+                (reinterpret_cast<UInt8 *>(&pixel_array[std::size_t(rows.begin)*SCREEN_WIDTH]),
+                 SCREEN_WIDTH, unsigned(rows.end - rows.begin), 0, unsigned(rows.begin));
+        }
 
         window.draw(screen_sprite);
 
@@ -397,14 +584,14 @@ void in_windowed_mode
 #   else
     (void)opts;
     (void)console;
-    (void)do_between_cycles;
+    (void)run_frame;
 #   endif
 }
 
 template <typename Func>
 void in_terminal_mode
     (const ProgramOptions &, erfin::Console & console,
-     Func && do_between_cycles)
+     Func && run_frame)
 {
     using namespace erfin;
     using MicroSeconds = std::chrono::duration<int, std::micro>;
@@ -420,8 +607,10 @@ void in_terminal_mode
 #   endif
 
     while (!console.trying_to_shutdown()) {
-        console.run_until_wait_with_post_frame(std::move(do_between_cycles));
-        std::this_thread::sleep_for(MicroSeconds(16667));
+        run_frame();
+        // on virtual time, frames run as fast as the host allows
+        if (!console.on_virtual_time())
+            std::this_thread::sleep_for(MicroSeconds(16667));
     }
     print_frame(console);
 
@@ -493,12 +682,20 @@ void process_events(erfin::Console & console, sf::Window & window) {
 }
 
 void map_screen_to_texture
-    (const erfin::Console & console, std::vector<erfin::UInt32> & raw_pixels)
+    (const erfin::Console & console, std::vector<erfin::UInt32> & raw_pixels,
+     const erfin::ErfiGpu::RowSpan & rows)
 {
-    auto scr_itr = console.current_screen().begin();
-    for (auto & pix : raw_pixels) {
-        assert(scr_itr != console.current_screen().end());
-        pix = *scr_itr++ ? ~0u : 0;
+    using erfin::ErfiGpu;
+    // rows never share words, so the packed screen unpacks in order
+    const auto & screen = console.current_screen();
+    auto pix_itr = raw_pixels.begin() + rows.begin*ErfiGpu::SCREEN_WIDTH;
+    auto beg = screen.begin() + rows.begin*ErfiGpu::WORDS_PER_ROW;
+    auto end = screen.begin() + rows.end  *ErfiGpu::WORDS_PER_ROW;
+    for (auto itr = beg; itr != end; ++itr) {
+        for (int i = ErfiGpu::BITS_PER_VIDEO_WORD - 1; i != -1; --i) {
+            assert(pix_itr != raw_pixels.end());
+            *pix_itr++ = ((*itr >> i) & 1) ? ~0u : 0;
+        }
     }
 }
 
@@ -515,6 +712,15 @@ void global_console_pointer_access(Func && f) {
 }
 #endif
 
+void apply_clock_options(const ProgramOptions & opts, erfin::Console & console) {
+    if (opts.virtual_frame_rate) {
+        console.set_virtual_time_step
+            (erfin::to_fixed_point(1.0 / double(opts.virtual_frame_rate)));
+    }
+    if (opts.has_rng_seed)
+        console.seed_rng(opts.rng_seed);
+}
+
 void print_frame(const erfin::Console & console) {
     erfin::Debugger debugger;
     console.update_with_current_state(debugger);
@@ -22,6 +22,7 @@
 #include "parse_program_options.hpp"
 
 #include "Assembler.hpp"
+#include "BatchRunner.hpp"
 #include "StringUtil.hpp"
 
 #include <iostream>
@@ -47,13 +48,16 @@ constexpr const bool should_window_default =
 struct TempOptions final : erfin::ProgramOptions {
     TempOptions():
         should_watch(false), should_window(should_window_default),
-        should_help(false), should_test(false)
+        should_help(false), should_test(false), should_batch(false),
+        should_benchmark(false)
     {}
     void swap(OptionsPair &);
     bool should_watch;
     bool should_window;
     bool should_help;
     bool should_test;
+    bool should_batch;
+    bool should_benchmark;
 };
 
 OptionsPair initlist_to_opts(const std::initializer_list<const char * const> &);
@@ -87,6 +91,28 @@ void select_stream_input(TempOptions &, char**, char **);
 
 void select_window_scale(TempOptions &, char ** beg, char ** end);
 
+void select_dispatch(TempOptions &, char ** beg, char ** end);
+
+void select_virtual_time(TempOptions &, char ** beg, char ** end);
+
+void select_rng_seed(TempOptions &, char ** beg, char ** end);
+
+void select_batch(TempOptions &, char ** beg, char ** end);
+
+void select_batch_jobs(TempOptions &, char ** beg, char ** end);
+
+void select_frame_limit(TempOptions &, char ** beg, char ** end);
+
+void select_blit_benchmark(TempOptions &, char **, char **);
+
+void select_record(TempOptions &, char ** beg, char ** end);
+
+void select_golden_frames(TempOptions &, char ** beg, char ** end);
+
+void select_render_audio(TempOptions &, char ** beg, char ** end);
+
+void select_update_golden(TempOptions &, char **, char **);
+
 OptionsPair to_options_pair(TempOptions & topts);
 
 static const struct {
@@ -94,14 +120,25 @@ static const struct {
     const char * longform;
     ProcessOptionFunc process;
 } options_table_c [] = {
-    { 'b', "break-points" , add_break_points    },
-    { 'c', "command-line" , select_cli          },
-    { 'h', "help"         , select_help         },
-    { 'i', "input"        , select_input        },
-    { 'r', "stream-input" , select_stream_input },
-    { 's', "window-scale" , select_window_scale },
-    { 't', "run-tests"    , select_tests        },
-    { 'w', "watch"        , select_watched      }
+    { 'a', "render-audio"   , select_render_audio   },
+    { 'b', "break-points"   , add_break_points      },
+    { 'c', "command-line"   , select_cli            },
+    { 'd', "dispatch"       , select_dispatch       },
+    { 'e', "seed"           , select_rng_seed       },
+    { 'f', "frame-limit"    , select_frame_limit    },
+    { 'g', "golden-frames"  , select_golden_frames  },
+    { 'h', "help"           , select_help           },
+    { 'i', "input"          , select_input          },
+    { 'j', "jobs"           , select_batch_jobs     },
+    { 'k', "blit-benchmark" , select_blit_benchmark },
+    { 'm', "batch"          , select_batch          },
+    { 'o', "record"         , select_record         },
+    { 'r', "stream-input"   , select_stream_input   },
+    { 's', "window-scale"   , select_window_scale   },
+    { 't', "run-tests"      , select_tests          },
+    { 'u', "update-golden"  , select_update_golden  },
+    { 'v', "virtual-time"   , select_virtual_time   },
+    { 'w', "watch"          , select_watched        }
 };
 
 } // end of <anonymous> namespace
@@ -141,7 +178,14 @@ int InitListArgs::argc() const { return int(m_pointers.size()); }
 ProgramOptions::ProgramOptions():
     window_scale(3),
     watched_history_length(DEFAULT_FRAME_LIMIT),
-    input_stream_ptr(nullptr)
+    input_stream_ptr(nullptr),
+    cpu_dispatcher(ErfiCpu::DEFAULT_DISPATCHER),
+    virtual_frame_rate(0),
+    has_rng_seed(false),
+    rng_seed(0),
+    batch_jobs(0),
+    batch_frame_limit(BatchRunner::DEFAULT_FRAME_LIMIT),
+    update_golden(false)
 {}
 
 ProgramOptions::ProgramOptions(ProgramOptions && lhs):
@@ -158,6 +202,17 @@ void ProgramOptions::swap(ProgramOptions & lhs) {
     std::swap(watched_history_length, lhs.watched_history_length);
     std::swap(input_stream_ptr      , lhs.input_stream_ptr      );
     std::swap(break_points          , lhs.break_points          );
+    std::swap(cpu_dispatcher        , lhs.cpu_dispatcher        );
+    std::swap(virtual_frame_rate    , lhs.virtual_frame_rate    );
+    std::swap(has_rng_seed          , lhs.has_rng_seed          );
+    std::swap(rng_seed              , lhs.rng_seed              );
+    std::swap(batch_inputs          , lhs.batch_inputs          );
+    std::swap(batch_jobs            , lhs.batch_jobs            );
+    std::swap(batch_frame_limit     , lhs.batch_frame_limit     );
+    std::swap(golden_filename       , lhs.golden_filename       );
+    std::swap(update_golden         , lhs.update_golden         );
+    std::swap(record_filename       , lhs.record_filename       );
+    std::swap(render_audio_filename , lhs.render_audio_filename );
 }
 
 /* static */ void ProgramOptions::run_parse_tests() {
@@ -166,6 +221,64 @@ void ProgramOptions::swap(ProgramOptions & lhs) {
     assert(read_opts.input_stream_ptr == &std::cin);
     assert(read_opts.mode == watched_cli_run);
     }
+    {
+    auto read_opts = initlist_to_opts({"./erfindung", "-r", "-d", "switch", "-c"});
+    assert(read_opts.cpu_dispatcher == ErfiCpu::Dispatcher::SWITCH);
+    assert(read_opts.mode == cli_run);
+    }
+    {
+    auto read_opts = initlist_to_opts({"./erfindung", "-r", "--dispatch", "threaded", "-c"});
+    assert(read_opts.cpu_dispatcher == ErfiCpu::Dispatcher::THREADED);
+    }
+    {
+    auto read_opts = initlist_to_opts
+        ({"./erfindung", "--batch", "a.efas", "b.efas", "-j", "4", "-f", "60"});
+    assert(read_opts.mode == batch_run);
+    assert(read_opts.batch_inputs.size() == 2);
+    assert(read_opts.batch_inputs[1] == "b.efas");
+    assert(read_opts.batch_jobs == 4 && read_opts.batch_frame_limit == 60);
+    }
+    {
+    auto read_opts = initlist_to_opts({"./erfindung", "--blit-benchmark"});
+    assert(read_opts.mode == blit_benchmark);
+    }
+    {
+    auto read_opts = initlist_to_opts({"./erfindung", "-r", "-v", "-c"});
+    assert(read_opts.virtual_frame_rate == DEFAULT_VIRTUAL_FRAME_RATE);
+    assert(!read_opts.has_rng_seed);
+    }
+    {
+    auto read_opts = initlist_to_opts
+        ({"./erfindung", "-r", "--virtual-time", "30", "--seed", "42", "-c"});
+    assert(read_opts.virtual_frame_rate == 30);
+    assert(read_opts.has_rng_seed && read_opts.rng_seed == 42);
+    }
+    {
+    auto read_opts = initlist_to_opts
+        ({"./erfindung", "-r", "--record", "frames.efrm", "-c"});
+    assert(read_opts.record_filename == "frames.efrm");
+    assert(read_opts.mode == cli_run);
+    }
+    {
+    auto read_opts = initlist_to_opts
+        ({"./erfindung", "-m", "a.efas", "-g", "golden.txt"});
+    assert(read_opts.golden_filename == "golden.txt");
+    assert(!read_opts.update_golden);
+    }
+    {
+    auto read_opts = initlist_to_opts
+        ({"./erfindung", "-m", "a.efas", "--golden-frames", "golden.txt",
+          "--update-golden"});
+    assert(read_opts.update_golden);
+    assert(read_opts.mode == batch_run);
+    }
+    {
+    auto read_opts = initlist_to_opts
+        ({"./erfindung", "-r", "--render-audio", "out.wav", "-f", "120"});
+    assert(read_opts.render_audio_filename == "out.wav");
+    assert(read_opts.batch_frame_limit == 120);
+    assert(read_opts.mode == render_audio);
+    }
 }
 
 OptionsPair::OptionsPair():
@@ -240,6 +353,12 @@ void TempOptions::swap(OptionsPair & lhs) {
         lhs.mode = print_help;
     } else if (should_test) {
         lhs.mode = run_tests;
+    } else if (should_batch) {
+        lhs.mode = batch_run;
+    } else if (should_benchmark) {
+        lhs.mode = blit_benchmark;
+    } else if (!lhs.render_audio_filename.empty()) {
+        lhs.mode = render_audio;
     } else if (should_window) {
 #       ifndef MACRO_BUILD_STL_ONLY
         if (should_watch) {
@@ -285,7 +404,8 @@ void select_input(TempOptions &opts, char ** beg, char ** end) {
         throw Error("Select input option requires an argument (source file).");
     }
     if (end - beg > 1) throw Error("Only one file can be loaded.");
-    if (opts.input_stream_ptr) throw Error(ONLY_ONE_INPUT_MSG);
+    if (opts.input_stream_ptr || !opts.batch_inputs.empty())
+        throw Error(ONLY_ONE_INPUT_MSG);
     opts.input_stream_ptr = new std::ifstream(*beg, std::ifstream::binary);
     opts.input_stream_ptr->unsetf(std::ios_base::skipws);
 }
@@ -325,6 +445,33 @@ void add_break_points(TempOptions & opts, char ** beg, char ** end) {
 void select_tests(TempOptions & opts, char**, char **)
     { opts.should_test = true; }
 
+void select_blit_benchmark(TempOptions & opts, char **, char **)
+    { opts.should_benchmark = true; }
+
+void select_record(TempOptions & opts, char ** beg, char ** end) {
+    if (end - beg != 1)
+        throw Error("Record option expects exactly one argument (the file "
+                    "to record to).");
+    opts.record_filename = *beg;
+}
+
+void select_golden_frames(TempOptions & opts, char ** beg, char ** end) {
+    if (end - beg != 1)
+        throw Error("Golden frames option expects exactly one argument (the "
+                    "file of golden frames).");
+    opts.golden_filename = *beg;
+}
+
+void select_update_golden(TempOptions & opts, char **, char **)
+    { opts.update_golden = true; }
+
+void select_render_audio(TempOptions & opts, char ** beg, char ** end) {
+    if (end - beg != 1)
+        throw Error("Render audio option expects exactly one argument (the "
+                    "WAV file to write).");
+    opts.render_audio_filename = *beg;
+}
+
 void select_stream_input(TempOptions & opts, char**, char **) {
     if (opts.input_stream_ptr) throw Error(ONLY_ONE_INPUT_MSG);
     opts.input_stream_ptr = &std::cin;
@@ -346,6 +493,63 @@ void select_window_scale(TempOptions & opts, char ** beg, char ** end) {
     opts.should_window = true;
 }
 
+void select_dispatch(TempOptions & opts, char ** beg, char ** end) {
+    using Dispatcher = erfin::ErfiCpu::Dispatcher;
+    if (end - beg != 1)
+        throw Error("Dispatch option expects exactly one argument.");
+    if (str_eq(*beg, "switch")) {
+        opts.cpu_dispatcher = Dispatcher::SWITCH;
+    } else if (str_eq(*beg, "threaded")) {
+        opts.cpu_dispatcher = Dispatcher::THREADED;
+    } else {
+        throw Error("Dispatch option expects either \"switch\" or "
+                    "\"threaded\".");
+    }
+}
+
+void select_virtual_time(TempOptions & opts, char ** beg, char ** end) {
+    opts.virtual_frame_rate = erfin::ProgramOptions::DEFAULT_VIRTUAL_FRAME_RATE;
+    if (end - beg == 0) return;
+    static constexpr const char * const NUM_ERR_MSG =
+        "Virtual time expects at most one argument, a base 10 positive "
+        "integer (frames per second).";
+    if (end - beg > 1) throw Error(NUM_ERR_MSG);
+    if (!to_dec_number(*beg, opts.virtual_frame_rate))
+        throw Error(NUM_ERR_MSG);
+    if (opts.virtual_frame_rate == 0)
+        throw Error(NUM_ERR_MSG);
+}
+
+void select_rng_seed(TempOptions & opts, char ** beg, char ** end) {
+    if (end - beg != 1)
+        throw Error("Seed option expects exactly one argument.");
+    if (!to_dec_number(*beg, opts.rng_seed))
+        throw Error("Seed option expects a base 10 non-negative integer.");
+    opts.has_rng_seed = true;
+}
+
+void select_batch(TempOptions & opts, char ** beg, char ** end) {
+    if (beg == end)
+        throw Error("Batch option requires at least one source file.");
+    if (opts.input_stream_ptr) throw Error(ONLY_ONE_INPUT_MSG);
+    opts.batch_inputs.insert(opts.batch_inputs.end(), beg, end);
+    opts.should_batch = true;
+}
+
+void select_batch_jobs(TempOptions & opts, char ** beg, char ** end) {
+    if (end - beg != 1)
+        throw Error("Jobs option expects exactly one argument.");
+    if (!to_dec_number(*beg, opts.batch_jobs))
+        throw Error("Jobs option expects a base 10 non-negative integer.");
+}
+
+void select_frame_limit(TempOptions & opts, char ** beg, char ** end) {
+    if (end - beg != 1)
+        throw Error("Frame limit option expects exactly one argument.");
+    if (!to_dec_number(*beg, opts.batch_frame_limit))
+        throw Error("Frame limit expects a base 10 non-negative integer.");
+}
+
 OptionsPair to_options_pair(TempOptions & topts) {
     OptionsPair rv;
     topts.swap(rv);
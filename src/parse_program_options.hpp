@@ -23,9 +23,11 @@
 #define MACRO_HEADER_GUARD_PARSE_PROGRAM_OPTIONS_HPP
 
 #include <vector>
+#include <string>
 #include <iosfwd>
 
 #include "ErfiDefs.hpp"
+#include "ErfiCpu.hpp"
 
 namespace erfin {
 struct ProgramOptions;
@@ -40,6 +42,9 @@ void watched_windowed_run(const erfin::ProgramOptions &, const erfin::ProgramDat
 void cli_run             (const erfin::ProgramOptions &, const erfin::ProgramData &);
 void watched_cli_run     (const erfin::ProgramOptions &, const erfin::ProgramData &);
 void print_help          (const erfin::ProgramOptions &, const erfin::ProgramData &);
+void batch_run           (const erfin::ProgramOptions &, const erfin::ProgramData &);
+void blit_benchmark      (const erfin::ProgramOptions &, const erfin::ProgramData &);
+void render_audio        (const erfin::ProgramOptions &, const erfin::ProgramData &);
 void run_tests           (const erfin::ProgramOptions &, const erfin::ProgramData &);
 
 // ----------- Options Parsing - implemented in respective source -------------
@@ -66,6 +71,7 @@ private:
 
 struct ProgramOptions {
     static constexpr const std::size_t DEFAULT_FRAME_LIMIT = 3;
+    static constexpr const unsigned DEFAULT_VIRTUAL_FRAME_RATE = 60;
 
     ProgramOptions();
     ProgramOptions(const ProgramOptions &) = delete;
@@ -84,6 +90,23 @@ struct ProgramOptions {
     std::vector<std::size_t> break_points;
     Assembler * assembler;
     std::istream * input_stream_ptr;
+    ErfiCpu::Dispatcher cpu_dispatcher;
+    // frames per second of virtual time, zero to follow the wall clock
+    // (batch runs always use virtual time)
+    unsigned virtual_frame_rate;
+    bool has_rng_seed;
+    UInt32 rng_seed;
+    // batch mode only
+    std::vector<std::string> batch_inputs;
+    unsigned batch_jobs; // zero for as many as the hardware supports
+    std::size_t batch_frame_limit; // also limits audio renders
+    // golden frame hashes batch runs are checked against, empty for none
+    std::string golden_filename;
+    bool update_golden; // write the golden frames rather than check them
+    // file every frame shown is recorded to, empty for none
+    std::string record_filename;
+    // WAV file the program's audio is rendered to, (audio render mode only)
+    std::string render_audio_filename;
 };
 
 struct OptionsPair final : ProgramOptions {
@@ -23,11 +23,19 @@
 
 #include "Assembler.hpp"
 #include "ErfiCpu.hpp"
+#include "ErfiGpu.hpp"
+#include "ErfiApu.hpp"
+#include "BatchRunner.hpp"
+#include "FrameRecorder.hpp"
+#include "WavWriter.hpp"
 
 #include "StringUtil.hpp"
+#include "SpscRing.hpp"
 #include "FixedPointUtil.hpp"
 #include "parse_program_options.hpp"
 
+#include <thread>
+
 #include <cstring>
 #include <cassert>
 
@@ -35,6 +43,7 @@ namespace {
 
 void test_string_processing();
 void test_string_to_number();
+void test_spsc_ring();
 
 }
 
@@ -44,12 +53,18 @@ void run_tests(const erfin::ProgramOptions &, const erfin::ProgramData &) {
     OstreamFormatSaver osfs(std::cout); (void)osfs;
 
     test_string_to_number();
+    test_spsc_ring();
     run_encode_decode_tests();
     run_fixed_point_tests();
     Assembler::run_tests();
     ErfiCpu::run_tests();
+    ErfiGpu::run_tests();
+    Apu::run_tests();
     test_string_processing();
     ProgramOptions::run_parse_tests();
+    BatchRunner::run_tests();
+    FrameRecorder::run_tests();
+    WavWriter::run_tests();
 
     std::cout << "All Internal Tests passed sucessfully." << std::endl;
 }
@@ -79,6 +94,63 @@ void test_string_processing() {
 
 
 
+void test_spsc_ring() {
+    using Ring = erfin::SpscRing<int, 8>;
+    {
+    Ring ring;
+    assert(ring.empty() && ring.front_span().size == 0);
+    for (int i = 0; i != 8; ++i) {
+        bool pushed = ring.push(i);
+        assert(pushed);
+        (void)pushed;
+    }
+    // full rings refuse more
+    assert(!ring.push(8));
+    assert(ring.size() == 8 && ring.peek(7) == 7);
+    ring.pop(6);
+    for (int i = 8; i != 12; ++i) ring.push(i);
+    // contents wrap around the end of the buffer, in two spans
+    auto span = ring.front_span();
+    assert(span.size == 2 && span.data[0] == 6 && span.data[1] == 7);
+    ring.pop(span.size);
+    span = ring.front_span();
+    assert(span.size == 4 && span.data[0] == 8 && span.data[3] == 11);
+    ring.clear();
+    assert(ring.empty());
+    }
+    // pushing several at a time wraps around too, and stops when full
+    {
+    Ring ring;
+    const int values[] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9 };
+    ring.push(values, 6);
+    ring.pop(4);
+    assert(ring.room() == 6);
+    assert(ring.push(values + 6, 4) == 4);
+    assert(ring.peek(0) == 4 && ring.peek(5) == 9);
+    assert(ring.push(values, 10) == 2 && ring.room() == 0);
+    assert(ring.peek(6) == 0 && ring.peek(7) == 1);
+    }
+    // everything pushed on one thread is popped on another, in order
+    {
+    std::unique_ptr<Ring> ring(new Ring());
+    static constexpr const int COUNT = 100000;
+    std::thread producer([&ring]() {
+        for (int i = 0; i != COUNT; ++i) {
+            while (!ring->push(i)) std::this_thread::yield();
+        }
+    });
+    for (int expected = 0; expected != COUNT; ) {
+        auto span = ring->front_span();
+        for (std::size_t i = 0; i != span.size; ++i)
+            assert(span.data[i] == expected + int(i));
+        expected += int(span.size);
+        ring->pop(span.size);
+    }
+    producer.join();
+    assert(ring->empty());
+    }
+}
+
 std::runtime_error make_failed_string_to_number() {
     return std::runtime_error("test_string_to_number: tests fail.");
 }